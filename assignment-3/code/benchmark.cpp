@@ -0,0 +1,318 @@
+#include "benchmark.h"
+#include "../include/glad/glad.h"
+#ifdef FOLIAGE_BENCHMARK_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include "../include/GLFW/install/include/GLFW/glfw3.h"
+#endif
+#include "foliage_renderer.h"
+#include "slime_character.h"
+#include "procedural_grid.h"
+#include "gpu_profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+
+const int BENCHMARK_WIDTH = 800;  // default window size, split into god and player views
+const int BENCHMARK_HEIGHT = 900;
+const unsigned BENCHMARK_SEED = 1234; // foliage mesh and rotation assignment
+
+// One column per frame; GPU columns are GPUProfiler scope names
+enum Metric {
+    METRIC_FRAME_MS, METRIC_CPU_CULL_MS, METRIC_CPU_SETUP_MS, METRIC_CPU_DRAW_MS, METRIC_CPU_COLLISION_MS,
+    METRIC_GPU_FRAME_MS, METRIC_GPU_CULL_MS, METRIC_GPU_DRAW_MS, METRIC_GPU_COLLISION_MS, METRIC_GPU_GRID_MS,
+    METRIC_GPU_SLIME_MS, METRIC_VISIBLE, METRIC_COLLISION_TESTS, METRIC_COLLISION_HITS, METRIC_COUNT
+};
+const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "frame_ms", "cpu_cull_ms", "cpu_setup_ms", "cpu_draw_ms", "cpu_collision_ms",
+    "gpu_frame_ms", "gpu_cull_ms", "gpu_draw_ms", "gpu_collision_ms", "gpu_grid_ms",
+    "gpu_slime_ms", "visible", "collision_tests", "collision_hits"
+};
+const char* const GPU_SCOPES[] = { "Frame", "Foliage cull", "Foliage draw", "Foliage collision", "Grid", "Slime" };
+const int GPU_SCOPE_COUNT = sizeof(GPU_SCOPES) / sizeof(GPU_SCOPES[0]);
+
+// The foliage shaders are #version 460 like the interactive window's context. Mesa's
+// llvmpipe implements 4.6 but only reports 4.5 unless told otherwise; has to happen before
+// the driver loads, and values already in the environment win
+void allowMesaGL46() {
+#ifndef _WIN32
+    setenv("MESA_GL_VERSION_OVERRIDE", "4.6", 0);
+    setenv("MESA_GLSL_VERSION_OVERRIDE", "460", 0);
+#endif
+}
+
+#ifdef FOLIAGE_BENCHMARK_EGL
+EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+EGLContext eglContext = EGL_NO_CONTEXT;
+EGLSurface eglSurface = EGL_NO_SURFACE;
+
+// Surfaceless where Mesa offers it (llvmpipe runs without any GPU or display), else a pbuffer
+bool createHeadlessContext() {
+    allowMesaGL46();
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    bool surfaceless = false;
+    if (getPlatformDisplay) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        surfaceless = eglDisplay != EGL_NO_DISPLAY && eglInitialize(eglDisplay, nullptr, nullptr);
+    }
+    if (!surfaceless) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr)) {
+            std::cerr << "Benchmark: no EGL display" << std::endl;
+            return false;
+        }
+    }
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        std::cerr << "Benchmark: no EGL config with desktop OpenGL" << std::endl;
+        return false;
+    }
+    const EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 6,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+    eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cerr << "Benchmark: failed to create an OpenGL 4.6 core EGL context" << std::endl;
+        return false;
+    }
+    if (!surfaceless) {
+        const EGLint pbufferAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+        eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+    }
+    if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+        std::cerr << "Benchmark: eglMakeCurrent failed" << std::endl;
+        return false;
+    }
+    return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+}
+
+void destroyHeadlessContext() {
+    if (eglDisplay == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (eglSurface != EGL_NO_SURFACE) eglDestroySurface(eglDisplay, eglSurface);
+    if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+    eglTerminate(eglDisplay);
+}
+#else
+GLFWwindow* hiddenWindow = nullptr;
+
+// Without EGL the context comes from a window that is never shown
+bool createHeadlessContext() {
+    allowMesaGL46();
+    if (!glfwInit()) return false;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    hiddenWindow = glfwCreateWindow(16, 16, "benchmark", NULL, NULL);
+    if (hiddenWindow == NULL) {
+        std::cerr << "Benchmark: failed to create a hidden GLFW window" << std::endl;
+        return false;
+    }
+    glfwMakeContextCurrent(hiddenWindow);
+    return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+}
+
+void destroyHeadlessContext() {
+    if (hiddenWindow) glfwDestroyWindow(hiddenWindow);
+    glfwTerminate();
+}
+#endif
+
+// Nearest rank on a sorted copy
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+struct SetResult {
+    std::string file;
+    size_t instances;
+    std::vector<double> columns[METRIC_COUNT];
+};
+
+// Renders every set with the scene objects living (and releasing their GL objects) in here
+bool recordSampleSets(const BenchmarkSettings& settings, const std::vector<std::string>& sampleFiles,
+                      std::vector<SetResult>& results) {
+    FoliageRenderer foliageRenderer;
+    SlimeCharacter slimeCharacter;
+    ProceduralGrid proceduralGrid;
+    GPUProfiler gpuProfiler;
+    if (!foliageRenderer.initialize() || !slimeCharacter.initialize() || !proceduralGrid.initialize()) {
+        std::cerr << "Benchmark: failed to initialize the scene" << std::endl;
+        return false;
+    }
+    if (gpuProfiler.initialize()) foliageRenderer.setGPUProfiler(&gpuProfiler);
+
+    // Offscreen target in place of the default framebuffer
+    GLuint framebuffer, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    const float aspectHalf = (BENCHMARK_WIDTH * 0.5f) / (float)BENCHMARK_HEIGHT;
+    const glm::vec3 godPosition(0.0f, 20.0f, 30.0f);
+    const glm::mat4 godView = glm::lookAt(godPosition, godPosition + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 godProjection = glm::perspective(glm::radians(45.0f), aspectHalf, 0.1f, 1000.0f);
+    const glm::mat4 playerProjection = glm::perspective(glm::radians(45.0f), aspectHalf, 0.1f, 100.0f);
+
+    for (const std::string& file : sampleFiles) {
+        srand(BENCHMARK_SEED);
+        foliageRenderer.loadPoissonSamples(file);
+        SetResult result;
+        result.file = file;
+        result.instances = foliageRenderer.getInstanceCount();
+
+        const int totalFrames = settings.warmupFrames + settings.frames;
+        for (int frame = 0; frame <= totalFrames; ++frame) {
+            // The previous frame finished on glFinish, so its timestamps are collected here
+            gpuProfiler.beginFrame();
+            int recorded = frame - 1 - settings.warmupFrames;
+            if (recorded >= 0) {
+                for (int s = 0; s < GPU_SCOPE_COUNT; ++s) {
+                    result.columns[METRIC_GPU_FRAME_MS + s][recorded] = gpuProfiler.scopeMs(GPU_SCOPES[s]);
+                }
+            }
+            if (frame == totalFrames) break;
+
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            gpuProfiler.begin("Frame");
+            // Player walks a circle at the interactive walking speed, the slime a figure eight
+            // across its path, so both views keep changing and trampling keeps hitting foliage
+            float time = frame * settings.deltaTime;
+            float playerAngle = time * 10.0f / 60.0f;
+            glm::vec3 playerPos(60.0f * std::cos(playerAngle), 7.0f, 60.0f * std::sin(playerAngle));
+            glm::vec3 playerFront(-std::sin(playerAngle), 0.0f, std::cos(playerAngle));
+            glm::mat4 playerView = glm::lookAt(playerPos, playerPos + playerFront, glm::vec3(0.0f, 1.0f, 0.0f));
+            float slimeAngle = time * 2.0f / 40.0f;
+            slimeCharacter.setPosition(glm::vec3(40.0f * std::sin(slimeAngle), 0.0f, 20.0f * std::sin(2.0f * slimeAngle)));
+            foliageRenderer.checkCollisions(slimeCharacter.getPosition(), 1.0f);
+
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            foliageRenderer.cull(playerView, playerProjection, playerPos);
+
+            glViewport(0, 0, BENCHMARK_WIDTH / 2, BENCHMARK_HEIGHT);
+            {
+                GPUProfileScope scope(&gpuProfiler, "Grid");
+                proceduralGrid.render(godView, godProjection);
+            }
+            foliageRenderer.draw(godView, godProjection, godPosition);
+            {
+                GPUProfileScope scope(&gpuProfiler, "Slime");
+                slimeCharacter.render(godView, godProjection);
+            }
+            glViewport(BENCHMARK_WIDTH / 2, 0, BENCHMARK_WIDTH / 2, BENCHMARK_HEIGHT);
+            {
+                GPUProfileScope scope(&gpuProfiler, "Grid");
+                proceduralGrid.render(playerView, playerProjection);
+            }
+            foliageRenderer.draw(playerView, playerProjection, playerPos);
+            {
+                GPUProfileScope scope(&gpuProfiler, "Slime");
+                slimeCharacter.render(playerView, playerProjection);
+            }
+            gpuProfiler.end();
+            // Stands in for the swap: the frame counts once the GPU is done with it
+            glFinish();
+            double frameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+
+            if (frame < settings.warmupFrames) continue;
+            const FoliageRenderer::ProfileData& prof = foliageRenderer.getProfileData();
+            result.columns[METRIC_FRAME_MS].push_back(frameMs);
+            result.columns[METRIC_CPU_CULL_MS].push_back(prof.cpuCullMs);
+            result.columns[METRIC_CPU_SETUP_MS].push_back(prof.cpuSetupMs);
+            result.columns[METRIC_CPU_DRAW_MS].push_back(prof.cpuDrawMs);
+            result.columns[METRIC_CPU_COLLISION_MS].push_back(prof.cpuCollisionLoopMs);
+            for (int s = 0; s < GPU_SCOPE_COUNT; ++s) result.columns[METRIC_GPU_FRAME_MS + s].push_back(0.0);
+            result.columns[METRIC_VISIBLE].push_back(foliageRenderer.readVisibleInstanceCount());
+            result.columns[METRIC_COLLISION_TESTS].push_back(prof.collisionTests);
+            result.columns[METRIC_COLLISION_HITS].push_back(prof.collisionHits);
+        }
+        results.push_back(result);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    return true;
+}
+
+} // namespace
+
+int runBenchmark(const BenchmarkSettings& settings, const std::vector<std::string>& sampleFiles) {
+    if (!createHeadlessContext()) {
+        std::cerr << "Benchmark: no offscreen OpenGL context" << std::endl;
+        destroyHeadlessContext();
+        return -1;
+    }
+    std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+    std::vector<SetResult> results;
+    bool recorded = recordSampleSets(settings, sampleFiles, results);
+    destroyHeadlessContext();
+    if (!recorded) return -1;
+
+    std::ofstream csv(settings.outputPrefix + ".csv");
+    csv << "set,frame";
+    for (int m = 0; m < METRIC_COUNT; ++m) csv << "," << METRIC_NAMES[m];
+    csv << "\n";
+    for (const SetResult& result : results) {
+        for (size_t frame = 0; frame < result.columns[0].size(); ++frame) {
+            csv << result.file << "," << frame;
+            for (int m = 0; m < METRIC_COUNT; ++m) csv << "," << result.columns[m][frame];
+            csv << "\n";
+        }
+    }
+
+    std::ofstream json(settings.outputPrefix + ".json");
+    json << "{\n  \"frames\": " << settings.frames << ",\n  \"warmupFrames\": " << settings.warmupFrames
+         << ",\n  \"deltaTime\": " << settings.deltaTime << ",\n  \"sets\": [";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const SetResult& result = results[r];
+        std::printf("\n%s (%zu instances, %d frames)\n", result.file.c_str(), result.instances, settings.frames);
+        std::printf("  %-18s %10s %10s %10s %10s\n", "metric", "mean", "p50", "p95", "p99");
+        json << (r ? "," : "") << "\n    {\n      \"file\": \"" << result.file << "\",\n      \"instances\": " << result.instances
+             << ",\n      \"metrics\": {";
+        for (int m = 0; m < METRIC_COUNT; ++m) {
+            const std::vector<double>& column = result.columns[m];
+            double p50 = percentile(column, 50.0), p95 = percentile(column, 95.0), p99 = percentile(column, 99.0);
+            std::printf("  %-18s %10.3f %10.3f %10.3f %10.3f\n", METRIC_NAMES[m], mean(column), p50, p95, p99);
+            json << (m ? "," : "") << "\n        \"" << METRIC_NAMES[m] << "\": { \"mean\": " << mean(column)
+                 << ", \"p50\": " << p50 << ", \"p95\": " << p95 << ", \"p99\": " << p99 << " }";
+        }
+        json << "\n      }\n    }";
+    }
+    json << "\n  ]\n}\n";
+    std::cout << "\nWrote " << settings.outputPrefix << ".csv and " << settings.outputPrefix << ".json" << std::endl;
+    return csv.good() && json.good() ? 0 : -1;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct BenchmarkSettings {
+    int frames = 600;              // recorded frames per sample set
+    int warmupFrames = 60;         // rendered before recording, left out of the results
+    float deltaTime = 1.0f / 60.0f; // fixed step for the scripted camera and slime paths
+    std::string outputPrefix = "benchmark"; // writes <prefix>.csv and <prefix>.json
+};
+
+// Headless run: renders each sample set offscreen along the same scripted camera and
+// slime path, writes per-frame timings and counts and prints p50/p95/p99 per set.
+// Returns the process exit code.
+int runBenchmark(const BenchmarkSettings& settings, const std::vector<std::string>& sampleFiles);
@@ -0,0 +1,192 @@
+// CPU-side microbenchmarks for the foliage renderer: asset loading, frustum plane
+// extraction, CPU culling and packing (and their scaling over threads) and the collision
+// loop. Needs no GL context.
+// Run from the assignment directory: foliage_bench [--runs N] [--max instances] [--threads N]
+#include "foliage_renderer.h"
+#include "frustum_cull_simd.h"
+#include "obj_loader.h"
+#include "spatial_sample_loader.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TimingStats {
+    double median = 0.0;
+    double min = 0.0;
+    double p90 = 0.0;
+};
+
+TimingStats summarize(std::vector<double> ms) {
+    TimingStats stats;
+    if (ms.empty()) return stats;
+    std::sort(ms.begin(), ms.end());
+    stats.min = ms.front();
+    stats.median = ms[ms.size() / 2];
+    stats.p90 = ms[std::min(ms.size() - 1, (ms.size() * 9) / 10)];
+    return stats;
+}
+
+// One discarded warmup call, then `runs` timed calls; run(i) gets the call index
+template <typename Fn>
+TimingStats measure(int runs, Fn run) {
+    run(-1);
+    std::vector<double> ms;
+    ms.reserve(runs);
+    for (int i = 0; i < runs; ++i) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        run(i);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return summarize(ms);
+}
+
+void printStats(const char* label, const TimingStats& stats) {
+    std::printf("  %-44s %10.4f %10.4f %10.4f\n", label, stats.median, stats.min, stats.p90);
+}
+
+// Uniform positions at the density of the 155k sample set (500 x 500 units); fixed seed
+std::vector<SpatialSamplePoint> syntheticSamples(size_t count) {
+    const float halfExtent = 250.0f * std::sqrt((float)count / 155304.0f);
+    std::mt19937 rng(1234u + (unsigned)count);
+    std::uniform_real_distribution<float> coord(-halfExtent, halfExtent);
+    std::uniform_real_distribution<float> angle(0.0f, 6.28318530718f);
+    std::vector<SpatialSamplePoint> samples(count);
+    for (SpatialSamplePoint& sample : samples) {
+        sample.position = glm::vec3(coord(rng), 0.0f, coord(rng));
+        sample.rotation = glm::vec3(0.0f, angle(rng), 0.0f);
+    }
+    return samples;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int runs = 15;
+    size_t maxInstances = 10000000;
+    unsigned maxThreads = 0; // one per core
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) runs = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--max") == 0 && i + 1 < argc) maxInstances = (size_t)std::atoll(argv[++i]);
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) maxThreads = (unsigned)std::max(1, std::atoi(argv[++i]));
+    }
+
+    FoliageRenderer renderer;
+    if (!renderer.initializeCPUOnly()) {
+        std::fprintf(stderr, "foliage_bench: meshes not found, run from the assignment directory\n");
+        return 1;
+    }
+    renderer.setCPUThreadCount(maxThreads);
+    maxThreads = renderer.getCPUThreadCount();
+    // Same stream of mesh assignments on every run
+    srand(1234);
+    // Loader and renderer logging goes to std::cout; the tables below use printf
+    std::cout.setstate(std::ios::failbit);
+
+    std::printf("\nfoliage_bench: ms over %d runs after one warmup run\n", runs);
+    std::printf("  %-44s %10s %10s %10s\n", "", "median", "min", "p90");
+
+    std::printf("Asset loading (OBJ through the cooked .mesh cache)\n");
+    const char* const meshes[] = { "assets/models/foliages/grassB.obj", "assets/models/foliages/bush01_lod2.obj",
+                                   "assets/models/foliages/bush05_lod2.obj" };
+    for (const char* path : meshes) {
+        printStats(("loadOBJ " + std::string(std::strrchr(path, '/') + 1)).c_str(), measure(runs, [&](int) {
+            Mesh mesh;
+            SimpleOBJLoader::loadOBJ(path, mesh);
+        }));
+    }
+    const char* const sampleSets[] = { "assets/models/spatialSamples/poissonPoints_1010s.ss2",
+                                       "assets/models/spatialSamples/poissonPoints_2797s.ss2",
+                                       "assets/models/spatialSamples/poissonPoints_155304s.ss2" };
+    for (const char* path : sampleSets) {
+        printStats(("loadSS2File " + std::string(std::strrchr(path, '/') + 1)).c_str(), measure(runs, [&](int) {
+            std::vector<SpatialSamplePoint> samples;
+            SpatialSampleLoader::loadSS2File(path, samples);
+        }));
+    }
+
+    // The interactive player camera: 400x900 viewport, 100 unit far plane
+    const glm::vec3 cameraPos(0.0f, 7.0f, 5.0f);
+    const glm::mat4 view = glm::lookAt(cameraPos, cameraPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 400.0f / 900.0f, 0.1f, 100.0f);
+    const glm::mat4 viewProjection = projection * view;
+    const int planeExtractions = 10000;
+    volatile float planeSink = 0.0f; // keeps the calls from being optimized away
+    TimingStats planes = measure(runs, [&](int) {
+        for (int i = 0; i < planeExtractions; ++i) planeSink += FoliageRenderer::extractFrustumPlanes(viewProjection)[i % 6].w;
+    });
+    // ms per batch -> microseconds per call
+    const double usPerCall = 1000.0 / planeExtractions;
+    planes.median *= usPerCall; planes.min *= usPerCall; planes.p90 *= usPerCall;
+    std::printf("Frustum planes\n");
+    printStats("extractFrustumPlanes (us per call)", planes);
+
+    const FrustumCull::Kernel kernel = FrustumCull::bestKernel();
+    std::printf("Synthetic sets at the 155k set's density, ms per call (cull kernel %s, %u threads)\n",
+                FrustumCull::kernelName(kernel), maxThreads);
+    std::printf("  %10s %10s %10s %10s %10s %10s %10s %10s %10s %8s\n", "instances", "load", "cull", "ns/inst",
+                "cull p90", "no cells", "nc scalar", "visible", "collide", "tests");
+    for (size_t count = 1000; count <= maxInstances; count *= 10) {
+        std::vector<SpatialSamplePoint> samples = syntheticSamples(count);
+        auto l0 = std::chrono::high_resolution_clock::now();
+        renderer.loadSamples(samples);
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - l0).count();
+        samples.clear();
+        samples.shrink_to_fit();
+
+        renderer.setCellCullingEnabled(true);
+        TimingStats cull = measure(runs, [&](int) { renderer.performFrustumCulling(view, projection, cameraPos); });
+        size_t visible = renderer.getCPUVisibleCount();
+        // Every sphere through the kernel, then the same with the scalar one
+        renderer.setCellCullingEnabled(false);
+        TimingStats cullNoCells = measure(runs, [&](int) { renderer.performFrustumCulling(view, projection, cameraPos); });
+        FrustumCull::setKernel(FrustumCull::KERNEL_SCALAR);
+        TimingStats cullScalar = measure(runs, [&](int) { renderer.performFrustumCulling(view, projection, cameraPos); });
+        FrustumCull::setKernel(kernel);
+        renderer.setCellCullingEnabled(true);
+
+        // A slime-sized collider stepping across the set, a fresh patch every call
+        unsigned long long tests = 0;
+        TimingStats collide = measure(runs, [&](int i) {
+            renderer.checkCollisions(glm::vec3(-20.0f + 2.5f * (i + 1), 0.0f, 0.0f), 1.0f);
+            if (i >= 0) tests += renderer.getProfileData().collisionTests;
+        });
+
+        std::printf("  %10zu %10.2f %10.4f %10.2f %10.4f %10.4f %10.4f %10zu %10.4f %8llu\n", count, loadMs, cull.median,
+                    cull.median * 1.0e6 / count, cull.p90, cullNoCells.median, cullScalar.median, visible, collide.median,
+                    tests / (unsigned long long)runs);
+    }
+
+    // Culling and packing from 1 to maxThreads threads, seen from above so every instance is
+    // visible and packed
+    const size_t scaleCount = std::min<size_t>(maxInstances, 1000000);
+    renderer.loadSamples(syntheticSamples(scaleCount));
+    const glm::vec3 overviewPos(0.0f, 1000.0f, 0.0f);
+    const glm::mat4 overviewView = glm::lookAt(overviewPos, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    const glm::mat4 overviewProjection = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 2000.0f);
+    std::printf("Thread scaling, %zu instances all in view, ms per call\n", scaleCount);
+    std::printf("  %10s %10s %10s %10s %10s %10s\n", "threads", "cull", "pack", "total", "speedup", "packed");
+    double singleThreadMs = 0.0;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        renderer.setCPUThreadCount(threads);
+        TimingStats cull = measure(runs, [&](int) { renderer.performFrustumCulling(overviewView, overviewProjection, overviewPos); });
+        size_t packed = 0;
+        TimingStats pack = measure(runs, [&](int) { packed = renderer.packVisibleInstances(overviewPos); });
+        double totalMs = cull.median + pack.median;
+        if (threads == 1) singleThreadMs = totalMs;
+        std::printf("  %10u %10.4f %10.4f %10.4f %9.2fx %10zu\n", threads, cull.median, pack.median, totalMs,
+                    singleThreadMs / totalMs, packed);
+        if (threads >= maxThreads) break;
+    }
+    return 0;
+}
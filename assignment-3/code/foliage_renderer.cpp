@@ -2,18 +2,32 @@
 #include "obj_loader.h"
 #include "spatial_sample_loader.h"
 #include "shader_code_loader.h"
+#include "mesh_optimizer.h"
+#include "gpu_profiler.h"
+#include "frustum_cull_simd.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
 #include <algorithm>
 #include <chrono>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <random>
 
 #include "../include/stb/stb_image.h"
 
+// Definitions for the class constants passed by reference (std::min/std::max)
+constexpr float FoliageRenderer::COLLISION_CELL_SIZE;
+const GLuint FoliageRenderer::COLLISION_READBACK_WINDOW;
+const GLsizeiptr FoliageRenderer::SAMPLE_UPLOAD_BYTES_PER_FRAME;
+
 FoliageRenderer::FoliageRenderer() 
     : m_instanceSSBO(0), m_drawCommandSSBO(0), m_indirectBuffer(0), 
       m_visibleInstanceSSBO(0), m_counterSSBO(0),
@@ -24,11 +38,39 @@ FoliageRenderer::FoliageRenderer()
 }
 
 FoliageRenderer::~FoliageRenderer() {
+    cancelSampleLoad();
+    stopStreaming();
     if(m_instanceSSBO) glDeleteBuffers(1, &m_instanceSSBO);
     if(m_drawCommandSSBO) glDeleteBuffers(1, &m_drawCommandSSBO);
     if(m_indirectBuffer) glDeleteBuffers(1, &m_indirectBuffer);
     if(m_visibleInstanceSSBO) glDeleteBuffers(1, &m_visibleInstanceSSBO);
     if(m_counterSSBO) glDeleteBuffers(1, &m_counterSSBO);
+    if(m_meshInfoSSBO) glDeleteBuffers(1, &m_meshInfoSSBO);
+    if(m_quantizedVAO) glDeleteVertexArrays(1, &m_quantizedVAO);
+    if(m_quantizedVBO) glDeleteBuffers(1, &m_quantizedVBO);
+    if(m_hizBuildShader) glDeleteProgram(m_hizBuildShader);
+    if(m_occlusionFBO) glDeleteFramebuffers(1, &m_occlusionFBO);
+    if(m_occlusionDepthTex) glDeleteTextures(1, &m_occlusionDepthTex);
+    if(m_hizTexture) glDeleteTextures(1, &m_hizTexture);
+    if(m_occlusionStatsSSBO) glDeleteBuffers(1, &m_occlusionStatsSSBO);
+    if(m_occludedListSSBO) glDeleteBuffers(1, &m_occludedListSSBO);
+    if(m_occlusionStatsReadback) glDeleteBuffers(1, &m_occlusionStatsReadback);
+    if(m_occlusionStatsFence) glDeleteSync(m_occlusionStatsFence);
+    if(m_collisionShader) glDeleteProgram(m_collisionShader);
+    if(m_cellCullShader) glDeleteProgram(m_cellCullShader);
+    if(m_sortShader) glDeleteProgram(m_sortShader);
+    if(m_compactShader) glDeleteProgram(m_compactShader);
+    if(m_decisionSSBO) glDeleteBuffers(1, &m_decisionSSBO);
+    if(m_groupCountSSBO) glDeleteBuffers(1, &m_groupCountSSBO);
+    if(m_sortScratchSSBO) glDeleteBuffers(1, &m_sortScratchSSBO);
+    if(m_sortBinsSSBO) glDeleteBuffers(1, &m_sortBinsSSBO);
+    if(m_overdrawQueries[0][0]) glDeleteQueries(OVERDRAW_QUERY_FRAMES * 2, &m_overdrawQueries[0][0]);
+    if(m_cellSSBO) glDeleteBuffers(1, &m_cellSSBO);
+    if(m_visibleCellSSBO) glDeleteBuffers(1, &m_visibleCellSSBO);
+    if(m_activeMaskSSBO) glDeleteBuffers(1, &m_activeMaskSSBO);
+    if(m_collisionHitsSSBO) glDeleteBuffers(1, &m_collisionHitsSSBO);
+    if(m_collisionHitsReadback) glDeleteBuffers(1, &m_collisionHitsReadback);
+    if(m_collisionHitsFence) glDeleteSync(m_collisionHitsFence);
     if(m_textureArray) glDeleteTextures(1, &m_textureArray);
     if(m_renderShader) glDeleteProgram(m_renderShader);
     if(m_frustumCullingShader) glDeleteProgram(m_frustumCullingShader);
@@ -38,6 +80,7 @@ FoliageRenderer::~FoliageRenderer() {
     if(m_frustumShader) glDeleteProgram(m_frustumShader);
     
     for(auto& mesh : m_meshes) {
+        if(!mesh.VAO) continue; // initializeCPUOnly
         glDeleteVertexArrays(1, &mesh.VAO);
         glDeleteBuffers(1, &mesh.VBO);
         glDeleteBuffers(1, &mesh.EBO);
@@ -62,18 +105,51 @@ bool FoliageRenderer::initialize() {
 
     const std::string buildCmdSrc = ShaderCodeLoader::loadShaderCode("shaders/build_cmd.comp");
     m_instanceUpdateShader = createComputeShader(buildCmdSrc);
+    if(!m_instanceUpdateShader){
+        std::cerr << "GPU command build compute shader failed, falling back to CPU readback" << std::endl;
+        m_gpuCommandBuildEnabled = false;
+    }
+
+    const std::string cellCullSrc = ShaderCodeLoader::loadShaderCode("shaders/foliage_cell_cull.comp");
+    m_cellCullShader = createComputeShader(cellCullSrc);
+    if(!m_cellCullShader){
+        std::cerr << "Cell culling compute shader failed, culling every instance" << std::endl;
+    }
+
+    const std::string sortSrc = ShaderCodeLoader::loadShaderCode("shaders/foliage_sort.comp");
+    m_sortShader = createComputeShader(sortSrc);
+    if(!m_sortShader){
+        std::cerr << "Sort compute shader failed, GPU-culled buckets stay unsorted" << std::endl;
+    }
+    glGenQueries(OVERDRAW_QUERY_FRAMES * 2, &m_overdrawQueries[0][0]);
+
+    const std::string compactSrc = ShaderCodeLoader::loadShaderCode("shaders/foliage_compact.comp");
+    m_compactShader = createComputeShader(compactSrc);
+    if(!m_compactShader){
+        std::cerr << "Compaction compute shader failed, culling keeps the atomic append" << std::endl;
+    }
+
+    const std::string collideSrc = ShaderCodeLoader::loadShaderCode("shaders/foliage_collide.comp");
+    m_collisionShader = createComputeShader(collideSrc);
+    if(!m_collisionShader){
+        std::cerr << "GPU collision compute shader failed, trampling stays on the CPU" << std::endl;
+        m_gpuCollisionEnabled = false;
+    } else {
+        glGenBuffers(1, &m_collisionHitsReadback);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_collisionHitsReadback);
+        glBufferData(GL_COPY_WRITE_BUFFER, (1 + COLLISION_READBACK_WINDOW) * sizeof(GLuint), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    initializeOcclusionCulling();
+    if(!m_stream.initialize(STREAM_BYTES_PER_FRAME)){
+        std::cerr << "Streaming uploads unavailable, falling back to glBufferSubData" << std::endl;
+    }
     
-    MeshData grassMesh, bush01Mesh, bush05Mesh;
-    
-    if(!loadMesh("assets/models/foliages/grassB.obj", grassMesh) ||
-       !loadMesh("assets/models/foliages/bush01_lod2.obj", bush01Mesh) ||
-       !loadMesh("assets/models/foliages/bush05_lod2.obj", bush05Mesh)) {
-        std::cerr << "Failed to load foliage meshes" << std::endl;
+    if(!loadFoliageMeshes(true)) {
         return false;
     }
     
-    m_meshes = {grassMesh, bush01Mesh, bush05Mesh};
-    
     // Setup texture array
     if(!loadTextures()) {
         std::cerr << "Failed to load textures" << std::endl;
@@ -83,6 +159,30 @@ bool FoliageRenderer::initialize() {
     return true;
 }
 
+bool FoliageRenderer::initializeCPUOnly() {
+    m_gpuCullingEnabled = false;
+    m_gpuCollisionEnabled = false;
+    return loadFoliageMeshes(false);
+}
+
+bool FoliageRenderer::loadFoliageMeshes(bool upload) {
+    MeshData grassMesh, bush01Mesh, bush05Mesh;
+    
+    if(!loadMesh("assets/models/foliages/grassB.obj", grassMesh, upload) ||
+       !loadMesh("assets/models/foliages/bush01_lod2.obj", bush01Mesh, upload) ||
+       !loadMesh("assets/models/foliages/bush05_lod2.obj", bush05Mesh, upload)) {
+        std::cerr << "Failed to load foliage meshes" << std::endl;
+        return false;
+    }
+    
+    loadLODChain("assets/models/foliages/grassB.obj", grassMesh);
+    loadLODChain("assets/models/foliages/bush01_lod2.obj", bush01Mesh);
+    loadLODChain("assets/models/foliages/bush05_lod2.obj", bush05Mesh);
+    
+    m_meshes = {grassMesh, bush01Mesh, bush05Mesh};
+    return true;
+}
+
 void FoliageRenderer::createQuadMesh(MeshData& meshData) {
     std::vector<float> vertices = {
         // positions         // normals           // texture coords
@@ -95,6 +195,10 @@ void FoliageRenderer::createQuadMesh(MeshData& meshData) {
     meshData.indices = {0, 1, 2, 2, 3, 0};
     meshData.indexCount = meshData.indices.size();
     meshData.baseVertex = 0;
+    meshData.boundsMin = glm::vec3(-0.5f, 0.0f, -0.5f);
+    meshData.boundsMax = glm::vec3(0.5f, 1.0f, 0.5f);
+    meshData.boundingCenter = (meshData.boundsMin + meshData.boundsMax) * 0.5f;
+    meshData.boundingRadius = glm::length(meshData.boundsMax - meshData.boundingCenter);
     
     glGenVertexArrays(1, &meshData.VAO);
     glGenBuffers(1, &meshData.VBO);
@@ -127,70 +231,226 @@ void FoliageRenderer::loadPoissonSamples(const std::string& filename) {
         std::cerr << "Failed to load spatial samples from " << filename << std::endl;
         return;
     }
-    
+    loadSamples(samples);
+}
+
+void FoliageRenderer::loadSamples(const std::vector<SpatialSamplePoint>& samples) {
+    cancelSampleLoad();
+    stopStreaming();
+    beginInstanceSet(samples.size());
     m_instances.clear();
     m_instances.reserve(samples.size());
-    m_activeInstanceIndices.clear();
-    m_activeInstancePositions.clear();
-    m_activeInstancePositions.reserve(samples.size());
     
     // Convert spatial samples to instances
     for (const auto& sample : samples) {
-        InstanceData instance;
-        instance.position = glm::vec3(sample.position.x, 0.0f, sample.position.z);
-        instance.rotation = sample.rotation.y;
-        // Randomly assign mesh types
-        float rand_val = static_cast<float>(rand()) / RAND_MAX;
-        if (rand_val < 0.98f) {
-            instance.meshType = 0;
-            instance.textureIndex = 0;
-        } else if (rand_val < 0.99f) {
-            instance.meshType = 1;
-            instance.textureIndex = 1;
-        } else {
-            instance.meshType = 2;
-            instance.textureIndex = 2;
-        }
-        
-        instance.isActive = true;
-        instance.isVisible = true;
-        
-        instance.modelMatrix = glm::mat4(1.0f);
-        instance.modelMatrix = glm::translate(instance.modelMatrix, instance.position);
-        instance.modelMatrix = glm::rotate(instance.modelMatrix, instance.rotation, glm::vec3(0, 1, 0));
-
-        uint32_t newIndex = (uint32_t)m_instances.size();
-        m_instances.push_back(instance);
-        m_activeInstancePositions.push_back((int)m_activeInstanceIndices.size());
-        m_activeInstanceIndices.push_back(newIndex);
+        m_instances.push_back(makeInstance(sample, static_cast<float>(rand()) / RAND_MAX));
     }
-    
+    buildInstanceCells(m_instances, m_cells);
+    buildCollisionGrid();
+    for(uint32_t newIndex = 0; newIndex < (uint32_t)m_instances.size(); ++newIndex){
+        addActiveInstance(newIndex);
+    }
+    printDistribution(m_instances);
+}
+
+void FoliageRenderer::printDistribution(const std::vector<InstanceData>& instances) {
     size_t grassCount=0,bush01Count=0,bush05Count=0; 
-    for(auto &inst : m_instances){ if(inst.meshType==0) grassCount++; else if(inst.meshType==1) bush01Count++; else if(inst.meshType==2) bush05Count++; }
+    for(auto &inst : instances){ if(inst.meshType==0) grassCount++; else if(inst.meshType==1) bush01Count++; else if(inst.meshType==2) bush05Count++; }
     std::cout << "Foliage distribution: grass=" << grassCount << " bush01=" << bush01Count << " bush05=" << bush05Count << std::endl;
 }
 
+void FoliageRenderer::beginInstanceSet(size_t instanceCount) {
+    m_hizValid = false;
+    m_cullDirty = true;
+    m_sourceDirty = true;
+    m_cullSpheresDirty = true;
+    // Pending hit readbacks refer to the old source layout
+    if(m_collisionHitsFence){
+        glDeleteSync(m_collisionHitsFence);
+        m_collisionHitsFence = 0;
+    }
+    m_collisionReadbackRequested = false;
+    m_activeInstanceIndices.clear();
+    m_activeInstancePositions.assign(instanceCount, -1);
+    m_activeMask.assign((instanceCount + 31) / 32, 0);
+    m_dirtyMaskWords.clear();
+}
+
+InstanceData FoliageRenderer::makeInstance(const SpatialSamplePoint& sample, float randVal) {
+    InstanceData instance;
+    instance.position = glm::vec3(sample.position.x, 0.0f, sample.position.z);
+    instance.rotation = sample.rotation.y;
+    // Randomly assign mesh types
+    if (randVal < 0.98f) {
+        instance.meshType = 0;
+        instance.textureIndex = 0;
+    } else if (randVal < 0.99f) {
+        instance.meshType = 1;
+        instance.textureIndex = 1;
+    } else {
+        instance.meshType = 2;
+        instance.textureIndex = 2;
+    }
+    
+    instance.isActive = false; // set by addActiveInstance
+    instance.lod = 0;
+    
+    instance.modelMatrix = glm::mat4(1.0f);
+    instance.modelMatrix = glm::translate(instance.modelMatrix, instance.position);
+    instance.modelMatrix = glm::rotate(instance.modelMatrix, instance.rotation, glm::vec3(0, 1, 0));
+    return instance;
+}
+
+void FoliageRenderer::buildInstanceCells(std::vector<InstanceData>& instances, std::vector<InstanceCell>& cells) const {
+    cells.clear();
+    if(instances.empty()) return;
+
+    glm::vec2 minXZ(instances[0].position.x, instances[0].position.z);
+    glm::vec2 maxXZ = minXZ;
+    for(const auto &inst : instances){
+        minXZ = glm::min(minXZ, glm::vec2(inst.position.x, inst.position.z));
+        maxXZ = glm::max(maxXZ, glm::vec2(inst.position.x, inst.position.z));
+    }
+    int width = (int)std::floor((maxXZ.x - minXZ.x) / INSTANCE_CELL_SIZE) + 1;
+    int depth = (int)std::floor((maxXZ.y - minXZ.y) / INSTANCE_CELL_SIZE) + 1;
+    std::vector<GLuint> cellOf(instances.size());
+    std::vector<GLuint> cellStart((size_t)width * depth + 1, 0);
+    for(size_t i = 0; i < instances.size(); ++i){
+        int cx = std::min((int)std::floor((instances[i].position.x - minXZ.x) / INSTANCE_CELL_SIZE), width - 1);
+        int cz = std::min((int)std::floor((instances[i].position.z - minXZ.y) / INSTANCE_CELL_SIZE), depth - 1);
+        cellOf[i] = (GLuint)(cz * width + cx);
+        cellStart[cellOf[i] + 1]++;
+    }
+    for(size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+
+    // Counting sort, stable within a cell
+    std::vector<InstanceData> sorted(instances.size());
+    std::vector<GLuint> cursor(cellStart.begin(), cellStart.end() - 1);
+    for(size_t i = 0; i < instances.size(); ++i) sorted[cursor[cellOf[i]]++] = instances[i];
+    instances.swap(sorted);
+
+    cells.resize((size_t)width * depth);
+    for(size_t c = 0; c < cells.size(); ++c){
+        InstanceCell &cell = cells[c];
+        cell.firstInstance = cellStart[c];
+        cell.instanceCount = cellStart[c + 1] - cellStart[c];
+        computeCellBounds(cell, instances);
+    }
+}
+
+void FoliageRenderer::computeCellBounds(InstanceCell& cell, const std::vector<InstanceData>& instances) const {
+    cell.meshCounts.assign(m_meshes.size(), 0);
+    cell.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    cell.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    for(GLuint i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; ++i){
+        const InstanceData &inst = instances[i];
+        glm::vec3 center = inst.position;
+        float radius = 0.0f;
+        if(inst.meshType < (int)m_meshes.size()){
+            const MeshData &mesh = m_meshes[inst.meshType];
+            center = glm::vec3(inst.modelMatrix * glm::vec4(mesh.boundingCenter, 1.0f));
+            radius = mesh.boundingRadius;
+            cell.meshCounts[inst.meshType]++;
+        }
+        cell.boundsMin = glm::min(cell.boundsMin, center - glm::vec3(radius));
+        cell.boundsMax = glm::max(cell.boundsMax, center + glm::vec3(radius));
+    }
+}
+
+FoliageRenderer::GPUInstancePacked FoliageRenderer::packInstance(const InstanceData& inst) {
+    const float twoPi = 6.28318530718f;
+    float turns = inst.rotation / twoPi;
+    turns -= std::floor(turns);
+    GLuint rotation = (GLuint)std::lround(turns * 65536.0f) & 0xFFFFu;
+    GPUInstancePacked packed;
+    packed.position = inst.position;
+    packed.packedInfo = rotation | ((GLuint)inst.meshType & 0xFFu) << 16 | ((GLuint)inst.textureIndex & 0xFFu) << 24;
+    return packed;
+}
+
 void FoliageRenderer::setupInstanceBuffers(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos) {
     if(!m_gpuCullingEnabled){
-        m_gpuInstances.clear();
-        m_gpuInstances.reserve(m_instances.size());
-        GLuint runningBase = 0;
-        for(int meshType=0; meshType<3; ++meshType){
-            auto &mesh = m_meshes[meshType];
-            mesh.baseInstance = runningBase;
-            mesh.instanceCount = 0;
-            for(const auto &inst : m_instances){
-                if(inst.meshType==meshType && inst.isActive && inst.isVisible){
-                    GPUInstancePacked packed; 
-                    packed.model = inst.modelMatrix; 
-                    packed.info = glm::vec4(static_cast<float>(inst.textureIndex), static_cast<float>(inst.meshType),0,0);
-                    m_gpuInstances.push_back(packed); 
-                    mesh.instanceCount++; 
-                    runningBase++;
+        GLuint instanceCount = layoutCPUBuckets();
+        GLsizeiptr bytes = (GLsizeiptr)instanceCount * sizeof(GPUInstancePacked);
+        reserveInstanceSSBO(bytes);
+        // Packed straight into the mapped upload ring unless the sort has to read them back
+        GLintptr offset = -1;
+        void* mapped = (m_frontToBackSortEnabled || bytes == 0) ? nullptr : m_stream.allocate(bytes, offset);
+        if(mapped){
+            packCPUBuckets(static_cast<GPUInstancePacked*>(mapped), cameraPos);
+            m_stream.copy(offset, m_instanceSSBO, 0, bytes);
+        } else {
+            m_gpuInstances.resize(instanceCount);
+            packCPUBuckets(m_gpuInstances.data(), cameraPos);
+            updateInstanceSSBO();
+        }
+    }
+}
+
+size_t FoliageRenderer::packVisibleInstances(const glm::vec3& cameraPos) {
+    m_gpuInstances.resize(layoutCPUBuckets());
+    packCPUBuckets(m_gpuInstances.data(), cameraPos);
+    return m_gpuInstances.size();
+}
+
+GLuint FoliageRenderer::layoutCPUBuckets() {
+    // Counting sort of the visible instances into (mesh, LOD) buckets
+    std::vector<GLuint> bucketCounts(commandCount(), 0);
+    for(const auto &chunk : m_cullChunks){
+        for(size_t bucket=0; bucket<chunk.bucketCounts.size(); ++bucket) bucketCounts[bucket] += chunk.bucketCounts[bucket];
+    }
+    std::vector<GLuint> bucketOffsets(commandCount(), 0);
+    GLuint runningBase = 0;
+    for(size_t bucket=0; bucket<bucketCounts.size(); ++bucket){
+        bucketOffsets[bucket] = runningBase;
+        runningBase += bucketCounts[bucket];
+    }
+    for(size_t meshType=0; meshType<m_meshes.size(); ++meshType){
+        auto &mesh = m_meshes[meshType];
+        mesh.baseInstance = bucketOffsets[meshType * MAX_LODS];
+        mesh.instanceCount = 0;
+        for(size_t lod=0; lod<mesh.lods.size(); ++lod){
+            mesh.lods[lod].baseInstance = bucketOffsets[meshType * MAX_LODS + lod];
+            mesh.lods[lod].instanceCount = bucketCounts[meshType * MAX_LODS + lod];
+            mesh.instanceCount += mesh.lods[lod].instanceCount;
+        }
+    }
+    // Inside a bucket the chunks follow each other in cell order
+    for(auto &chunk : m_cullChunks){
+        for(size_t bucket=0; bucket<chunk.bucketCounts.size(); ++bucket){
+            chunk.bucketCursor[bucket] = bucketOffsets[bucket];
+            bucketOffsets[bucket] += chunk.bucketCounts[bucket];
+        }
+    }
+    return runningBase;
+}
+
+void FoliageRenderer::packCPUBuckets(GPUInstancePacked* dst, const glm::vec3& cameraPos) {
+    const size_t meshCount = m_meshes.size();
+    m_jobs.parallelFor(m_cullChunks.size(), 1, [&](size_t begin, size_t end, unsigned){
+        for(size_t j=begin; j<end; ++j){
+            CullChunk &chunk = m_cullChunks[j];
+            for(size_t meshType=0; meshType<chunk.visibleCounts.size(); ++meshType){
+                const GLuint* visible = m_cpuVisible.data() + m_cullSpheres.runVisible[chunk.firstCell * meshCount + meshType];
+                for(GLuint k=0; k<chunk.visibleCounts[meshType]; ++k){
+                    const InstanceData &inst = m_instances[visible[k]];
+                    dst[chunk.bucketCursor[meshType * MAX_LODS + inst.lod]++] = packInstance(inst);
                 }
             }
         }
-        updateInstanceSSBO();
+    });
+    if(m_frontToBackSortEnabled){
+        m_jobs.parallelFor(commandCount(), 1, [&](size_t begin, size_t end, unsigned){
+            for(size_t bucket=begin; bucket<end; ++bucket){
+                const MeshData &mesh = m_meshes[bucket / MAX_LODS];
+                size_t lod = bucket % MAX_LODS;
+                if(lod >= mesh.lods.size()) continue;
+                GPUInstancePacked* first = dst + mesh.lods[lod].baseInstance;
+                std::sort(first, first + mesh.lods[lod].instanceCount, [&cameraPos](const GPUInstancePacked& a, const GPUInstancePacked& b){
+                    return glm::dot(a.position - cameraPos, a.position - cameraPos) < glm::dot(b.position - cameraPos, b.position - cameraPos);
+                });
+            }
+        });
     }
 }
 
@@ -253,19 +513,22 @@ bool FoliageRenderer::loadTextures() {
 }
 
 void FoliageRenderer::updateInstanceSSBO() {
+    GLsizeiptr requiredSize = static_cast<GLsizeiptr>(m_gpuInstances.size() * sizeof(GPUInstancePacked));
+    reserveInstanceSSBO(requiredSize);
+    m_stream.upload(m_instanceSSBO, 0, m_gpuInstances.data(), requiredSize);
+}
+
+void FoliageRenderer::reserveInstanceSSBO(GLsizeiptr size) {
     if(m_instanceSSBO == 0) {
         glGenBuffers(1, &m_instanceSSBO);
     }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceSSBO);
-    GLsizeiptr requiredSize = static_cast<GLsizeiptr>(m_gpuInstances.size() * sizeof(GPUInstancePacked));
-    static GLsizeiptr allocated = 0;
-    if(requiredSize > allocated) {
-        glBufferData(GL_SHADER_STORAGE_BUFFER, requiredSize, m_gpuInstances.data(), GL_DYNAMIC_DRAW);
-        allocated = requiredSize;
-    } else {
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, requiredSize, m_gpuInstances.data());
+    // Storage only grows; the contents are streamed
+    if(size > m_instanceSSBOSize) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        m_instanceSSBOSize = size;
     }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void FoliageRenderer::initializeFrustumVisualization() {
@@ -286,6 +549,8 @@ void FoliageRenderer::initializeFrustumVisualization() {
     glBindVertexArray(m_frustumVAO);
     glBindBuffer(GL_ARRAY_BUFFER, m_frustumVBO);
     
+    // 12 edges, rewritten through m_stream every draw
+    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     
@@ -326,9 +591,8 @@ void FoliageRenderer::renderFrustumFrame(const glm::mat4& view, const glm::mat4&
     frustumLines.push_back(frustumCorners[2]); frustumLines.push_back(frustumCorners[6]);
     frustumLines.push_back(frustumCorners[3]); frustumLines.push_back(frustumCorners[7]);
     
+    m_stream.upload(m_frustumVBO, 0, frustumLines.data(), frustumLines.size() * sizeof(glm::vec3));
     glBindVertexArray(m_frustumVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_frustumVBO);
-    glBufferData(GL_ARRAY_BUFFER, frustumLines.size() * sizeof(glm::vec3), frustumLines.data(), GL_DYNAMIC_DRAW);
     
     glUseProgram(m_frustumShader);
     glUniformMatrix4fv(glGetUniformLocation(m_frustumShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
@@ -482,36 +746,143 @@ void FoliageRenderer::performFrustumCulling(const glm::mat4& view, const glm::ma
 
     // Extract frustum planes
     std::vector<glm::vec4> frustumPlanes = extractFrustumPlanes(viewProjection);
-    const float boundingRadius = 1.5f; // uniform sphere radius (could vary per mesh)
-    
-    uint32_t visibleCount = 0;
-    uint32_t totalActiveCount = 0;
-    
-    for(auto& instance : m_instances) {
-        if(!instance.isActive) {
-            instance.isVisible = false;
-            continue;
-        }
-        
-        totalActiveCount++;
-        
-        bool insideFrustum = true;
-        // Plane tests
-        for(const auto& plane : frustumPlanes) {
-            float distance = plane.x * instance.position.x +
-                             plane.y * instance.position.y +
-                             plane.z * instance.position.z +
-                             plane.w;
-            if(distance < -boundingRadius) { // sphere entirely outside
-                insideFrustum = false;
-                break;
+
+    if(m_cullSpheresDirty) rebuildCullSpheres();
+    m_jobs.parallelFor(m_cullChunks.size(), 1, [&](size_t begin, size_t end, unsigned){
+        for(size_t j = begin; j < end; ++j) cullChunk(m_cullChunks[j], frustumPlanes, cameraPos, projection[1][1]);
+    });
+}
+
+void FoliageRenderer::cullChunk(CullChunk& chunk, const std::vector<glm::vec4>& frustumPlanes, const glm::vec3& cameraPos, float lodScale) {
+    const CullSpheres& spheres = m_cullSpheres;
+    const size_t meshCount = chunk.visibleCounts.size();
+    std::fill(chunk.visibleCounts.begin(), chunk.visibleCounts.end(), 0);
+    std::fill(chunk.bucketCounts.begin(), chunk.bucketCounts.end(), 0);
+    const GLuint* chunkVisible = spheres.runVisible.data() + chunk.firstCell * meshCount;
+
+    for(GLuint c = chunk.firstCell; c < chunk.cellEnd; ++c) {
+        const InstanceCell& cell = m_cells[c];
+        // A cell whose box is outside one plane rejects all its instances at once
+        bool cellInside = true;
+        if(m_cellCullingEnabled) {
+            for(const auto& plane : frustumPlanes) {
+                glm::vec3 corner(plane.x >= 0.0f ? cell.boundsMax.x : cell.boundsMin.x,
+                                 plane.y >= 0.0f ? cell.boundsMax.y : cell.boundsMin.y,
+                                 plane.z >= 0.0f ? cell.boundsMax.z : cell.boundsMin.z);
+                if(glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                    cellInside = false;
+                    break;
+                }
             }
         }
-        instance.isVisible = insideFrustum;
-        if(instance.isVisible) {
-            visibleCount++;
+        if(!cellInside) continue;
+        // Sphere tests per run, appended to the chunk's part of the mesh's visible list
+        for(size_t meshType = 0; meshType < meshCount; ++meshType) {
+            GLuint first = spheres.runStart[c * meshCount + meshType];
+            GLuint count = spheres.runStart[c * meshCount + meshType + 1] - first;
+            if(count == 0) continue;
+            GLuint* out = m_cpuVisible.data() + chunkVisible[meshType] + chunk.visibleCounts[meshType];
+            chunk.visibleCounts[meshType] += (GLuint)FrustumCull::cullSpheres(&spheres.x[first], &spheres.y[first], &spheres.z[first],
+                                                                              &spheres.radius[first], count, frustumPlanes.data(), first, out);
+        }
+    }
+
+    // Sphere indices to instance indices, LOD for the visible instances only
+    for(size_t meshType = 0; meshType < meshCount; ++meshType) {
+        const MeshData& mesh = m_meshes[meshType];
+        GLuint* visible = m_cpuVisible.data() + chunkVisible[meshType];
+        for(GLuint k = 0; k < chunk.visibleCounts[meshType]; ++k) {
+            GLuint sphere = visible[k];
+            glm::vec3 center(spheres.x[sphere], spheres.y[sphere], spheres.z[sphere]);
+            visible[k] = spheres.instance[sphere];
+            int lod = selectLOD(mesh, center, cameraPos, lodScale);
+            m_instances[visible[k]].lod = lod;
+            chunk.bucketCounts[meshType * MAX_LODS + lod]++;
+        }
+    }
+}
+
+size_t FoliageRenderer::getCPUVisibleCount() const {
+    size_t visible = 0;
+    for(const auto& chunk : m_cullChunks) {
+        for(GLuint count : chunk.visibleCounts) visible += count;
+    }
+    return visible;
+}
+
+void FoliageRenderer::rebuildCullSpheres() {
+    const size_t meshCount = m_meshes.size();
+    CullSpheres& spheres = m_cullSpheres;
+    // Counting sort of the cell instances into (cell, mesh) runs, stable within a run
+    spheres.runStart.assign(m_cells.size() * meshCount + 1, 0);
+    for(size_t c = 0; c < m_cells.size(); ++c) {
+        for(size_t meshType = 0; meshType < meshCount && meshType < m_cells[c].meshCounts.size(); ++meshType) {
+            spheres.runStart[c * meshCount + meshType + 1] = m_cells[c].meshCounts[meshType];
+        }
+    }
+    for(size_t r = 1; r < spheres.runStart.size(); ++r) spheres.runStart[r] += spheres.runStart[r - 1];
+    size_t total = spheres.runStart.back();
+    spheres.x.resize(total);
+    spheres.y.resize(total);
+    spheres.z.resize(total);
+    spheres.radius.resize(total);
+    spheres.instance.resize(total);
+    m_cullSphereSlots.assign(m_instances.size(), ~0u);
+
+    std::vector<GLuint> cursor(spheres.runStart.begin(), spheres.runStart.end() - 1);
+    for(size_t c = 0; c < m_cells.size(); ++c) {
+        const InstanceCell& cell = m_cells[c];
+        for(GLuint i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; ++i) {
+            const InstanceData& instance = m_instances[i];
+            if(instance.meshType < 0 || instance.meshType >= (int)meshCount) continue;
+            // Per-mesh bounding sphere moved into world space
+            const MeshData& mesh = m_meshes[instance.meshType];
+            glm::vec3 center = glm::vec3(instance.modelMatrix * glm::vec4(mesh.boundingCenter, 1.0f));
+            GLuint sphere = cursor[c * meshCount + instance.meshType]++;
+            spheres.x[sphere] = center.x;
+            spheres.y[sphere] = center.y;
+            spheres.z[sphere] = center.z;
+            spheres.radius[sphere] = instance.isActive ? mesh.boundingRadius : -std::numeric_limits<float>::max();
+            spheres.instance[sphere] = i;
+            m_cullSphereSlots[i] = sphere;
+        }
+    }
+
+    // Each run gets room for all of its spheres in its mesh's part of the visible list
+    m_cpuVisible.resize(total);
+    spheres.runVisible.assign(m_cells.size() * meshCount, 0);
+    GLuint offset = 0;
+    for(size_t meshType = 0; meshType < meshCount; ++meshType) {
+        for(size_t c = 0; c < m_cells.size(); ++c) {
+            spheres.runVisible[c * meshCount + meshType] = offset;
+            offset += spheres.runStart[c * meshCount + meshType + 1] - spheres.runStart[c * meshCount + meshType];
         }
     }
+
+    // Chunks depend on the layout only, so the output is the same for any thread count
+    m_cullChunks.clear();
+    for(GLuint c = 0; c < (GLuint)m_cells.size();) {
+        CullChunk chunk;
+        chunk.firstCell = c;
+        GLuint spheresInChunk = 0;
+        while(c < (GLuint)m_cells.size() && spheresInChunk < CULL_CHUNK_SPHERES) {
+            spheresInChunk += spheres.runStart[(c + 1) * meshCount] - spheres.runStart[c * meshCount];
+            ++c;
+        }
+        chunk.cellEnd = c;
+        chunk.visibleCounts.assign(meshCount, 0);
+        chunk.bucketCounts.assign(meshCount * MAX_LODS, 0);
+        chunk.bucketCursor.assign(meshCount * MAX_LODS, 0);
+        m_cullChunks.push_back(chunk);
+    }
+    m_cullSpheresDirty = false;
+}
+
+void FoliageRenderer::setCullSphereActive(uint32_t instIdx, bool active) {
+    // A dirty set is rebuilt from isActive anyway
+    if(m_cullSpheresDirty || instIdx >= m_cullSphereSlots.size() || m_cullSphereSlots[instIdx] == ~0u) return;
+    float radius = active ? m_meshes[m_instances[instIdx].meshType].boundingRadius : -std::numeric_limits<float>::max();
+    m_cullSpheres.radius[m_cullSphereSlots[instIdx]] = radius;
 }
 
 std::vector<glm::vec4> FoliageRenderer::extractFrustumPlanes(const glm::mat4& viewProjectionMatrix) {
@@ -539,26 +910,61 @@ std::vector<glm::vec4> FoliageRenderer::extractFrustumPlanes(const glm::mat4& vi
 
 void FoliageRenderer::render(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos,
                              const glm::mat4& playerView, const glm::mat4& playerProjection, const glm::vec3& playerPos) {
+    cull(playerView, playerProjection, playerPos);
+    draw(view, projection, cameraPos);
+}
+
+void FoliageRenderer::cull(const glm::mat4& playerView, const glm::mat4& playerProjection, const glm::vec3& playerPos) {
+    // Start of a new frame for the upload ring
+    m_stream.nextFrame();
+    advancePendingSampleSet();
+    m_profileData.cpuDrawMs = 0.0;
     if(m_instances.empty()) {
         return;
     }
+    if(!m_cullDirty && playerView == m_lastPlayerView && playerProjection == m_lastPlayerProjection &&
+       playerPos == m_lastCameraPos) {
+        // Instance SSBO and indirect buffer still hold this frustum's result
+        m_profileData.cpuCullMs = 0.0;
+        m_profileData.cpuSetupMs = 0.0;
+        return;
+    }
+    m_lastPlayerView = playerView;
+    m_lastPlayerProjection = playerProjection;
+    m_lastCameraPos = playerPos;
+    m_cullDirty = false;
+    // combined buffers must exist before GPU command build reads firstIndex
+    buildCombinedBuffers();
+    GPUProfileScope cullScope(m_gpuProfiler, "Foliage cull");
     auto t0 = std::chrono::high_resolution_clock::now();
     auto t1 = t0;
-    auto t2 = t0;
     if(m_gpuCullingEnabled){
-        if(m_sourceInstanceSSBO==0){
+        if(m_sourceInstanceSSBO==0 || m_sourceDirty){
             rebuildSourceInstanceBuffer();
         }
         dispatchComputeCulling(playerView, playerProjection, playerPos);
         t1 = std::chrono::high_resolution_clock::now();
-        t2 = t1;
     } else {
         performFrustumCulling(playerView, playerProjection, playerPos);
         t1 = std::chrono::high_resolution_clock::now();
         setupInstanceBuffers(playerView, playerProjection, playerPos);
-        t2 = std::chrono::high_resolution_clock::now();
     }
-    
+    // GPU-built commands are already in m_indirectBuffer
+    if(!usesGPUCommandBuild()){
+        GPUProfileScope commandScope(m_gpuProfiler, "Foliage commands");
+        updateIndirectBuffer();
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+    using msd = std::chrono::duration<double, std::milli>;
+    m_profileData.cpuCullMs = std::chrono::duration_cast<msd>(t1 - t0).count();
+    m_profileData.cpuSetupMs = std::chrono::duration_cast<msd>(t3 - t1).count();
+}
+
+void FoliageRenderer::draw(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos) {
+    if(m_instances.empty() || !m_indirectBuffer) {
+        return;
+    }
+    GPUProfileScope drawScope(m_gpuProfiler, "Foliage draw");
     glUseProgram(m_renderShader);
     
     glUniformMatrix4fv(glGetUniformLocation(m_renderShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
@@ -572,70 +978,160 @@ void FoliageRenderer::render(const glm::mat4& view, const glm::mat4& projection,
     glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureArray);
     glUniform1i(glGetUniformLocation(m_renderShader, "textureArray"), 0);
     
-    buildCombinedBuffers();
     auto t3 = std::chrono::high_resolution_clock::now();
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceSSBO);
-    glBindVertexArray(m_combinedVAO);
-    updateIndirectBuffer();
+    bindCombinedVertices(m_renderShader);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    // Overdraw is measured on the player view only, skipping frames while every query is in flight
+    readOverdrawQueries();
+    const int query = m_overdrawQueryNext;
+    const bool measure = m_overdrawQueries[query][0] && !m_overdrawQueryPending[query] &&
+                         view == m_lastPlayerView && projection == m_lastPlayerProjection;
+    if(measure){
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, m_overdrawQueries[query][0]);
+        glBeginQuery(GL_SAMPLES_PASSED, m_overdrawQueries[query][1]);
+    }
     // Single multi-draw call (DrawElementsIndirectCommand array already laid out)
-    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)m_meshes.size(), 0);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)commandCount(), 0);
+    if(measure){
+        glEndQuery(GL_SAMPLES_PASSED);
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+        m_overdrawQueryPending[query] = true;
+        m_overdrawQueryNext = (query + 1) % OVERDRAW_QUERY_FRAMES;
+    }
     auto t4 = std::chrono::high_resolution_clock::now();
     using msd = std::chrono::duration<double, std::milli>;
-    m_profileData.cpuCullMs = std::chrono::duration_cast<msd>(t1 - t0).count();
-    m_profileData.cpuSetupMs = std::chrono::duration_cast<msd>(t2 - t1).count();
-    m_profileData.cpuDrawMs = std::chrono::duration_cast<msd>(t4 - t3).count();
+    // summed over every viewport drawn this frame
+    m_profileData.cpuDrawMs += std::chrono::duration_cast<msd>(t4 - t3).count();
     
-    renderFrustumFrame(view, projection, playerView, playerProjection);
+    renderFrustumFrame(view, projection, m_lastPlayerView, m_lastPlayerProjection);
+}
+
+int FoliageRenderer::collisionCellCoord(float v, float origin, int extent) const {
+    int c = (int)std::floor((v - origin) / m_collisionCellSize);
+    return std::min(std::max(c, 0), extent - 1);
+}
+
+void FoliageRenderer::buildCollisionGrid() {
+    if(m_instances.empty()) {
+        buildCollisionGrid(glm::vec2(0.0f), glm::vec2(0.0f));
+        return;
+    }
+    glm::vec2 minXZ(m_instances[0].position.x, m_instances[0].position.z);
+    glm::vec2 maxXZ = minXZ;
+    for(const auto &inst : m_instances){
+        minXZ = glm::min(minXZ, glm::vec2(inst.position.x, inst.position.z));
+        maxXZ = glm::max(maxXZ, glm::vec2(inst.position.x, inst.position.z));
+    }
+    buildCollisionGrid(minXZ, maxXZ);
+}
+
+void FoliageRenderer::buildCollisionGrid(const glm::vec2& minXZ, const glm::vec2& maxXZ) {
+    // Empty grid over the given extent, filled by addActiveInstance
+    m_collisionCells.clear();
+    m_collisionCellSlots.assign(m_instances.size(), -1);
+    m_collisionGridOrigin = minXZ;
+    float extent = std::max(maxXZ.x - minXZ.x, maxXZ.y - minXZ.y);
+    m_collisionCellSize = std::max(COLLISION_CELL_SIZE, extent / MAX_COLLISION_GRID_EXTENT);
+    m_collisionGridWidth = (int)std::floor((maxXZ.x - minXZ.x) / m_collisionCellSize) + 1;
+    m_collisionGridDepth = (int)std::floor((maxXZ.y - minXZ.y) / m_collisionCellSize) + 1;
+    m_collisionCells.resize((size_t)m_collisionGridWidth * m_collisionGridDepth);
+}
+
+void FoliageRenderer::addActiveInstance(uint32_t instIdx) {
+    InstanceData &instance = m_instances[instIdx];
+    instance.isActive = true;
+    m_activeMask[instIdx >> 5] |= 1u << (instIdx & 31);
+    setCullSphereActive(instIdx, true);
+    m_activeInstancePositions[instIdx] = (int)m_activeInstanceIndices.size();
+    m_activeInstanceIndices.push_back(instIdx);
+    int cx = collisionCellCoord(instance.position.x, m_collisionGridOrigin.x, m_collisionGridWidth);
+    int cz = collisionCellCoord(instance.position.z, m_collisionGridOrigin.y, m_collisionGridDepth);
+    std::vector<GLuint> &cell = m_collisionCells[(size_t)cz * m_collisionGridWidth + cx];
+    m_collisionCellSlots[instIdx] = (int)cell.size();
+    cell.push_back(instIdx);
+}
+
+void FoliageRenderer::removeActiveInstance(uint32_t instIdx) {
+    InstanceData &instance = m_instances[instIdx];
+    instance.isActive = false;
+    m_activeMask[instIdx >> 5] &= ~(1u << (instIdx & 31));
+    setCullSphereActive(instIdx, false);
+    // swap-remove from the active list
+    int pos = m_activeInstancePositions[instIdx];
+    uint32_t backIdx = m_activeInstanceIndices.back();
+    m_activeInstanceIndices[pos] = backIdx;
+    m_activeInstancePositions[backIdx] = pos;
+    m_activeInstanceIndices.pop_back();
+    m_activeInstancePositions[instIdx] = -1;
+    // and from its grid cell
+    int cx = collisionCellCoord(instance.position.x, m_collisionGridOrigin.x, m_collisionGridWidth);
+    int cz = collisionCellCoord(instance.position.z, m_collisionGridOrigin.y, m_collisionGridDepth);
+    std::vector<GLuint> &cell = m_collisionCells[(size_t)cz * m_collisionGridWidth + cx];
+    int slot = m_collisionCellSlots[instIdx];
+    uint32_t cellBack = cell.back();
+    cell[slot] = cellBack;
+    m_collisionCellSlots[cellBack] = slot;
+    cell.pop_back();
+    m_collisionCellSlots[instIdx] = -1;
 }
 
 void FoliageRenderer::checkCollisions(const glm::vec3& playerPos, float playerRadius) {
+    if(usesGPUCollisions()){
+        dispatchCollisionPass(std::vector<glm::vec4>(1, glm::vec4(playerPos, playerRadius)));
+        return;
+    }
+    // Hits still on the GPU must reach the CPU copy before it is rebuilt from
+    flushCollisionReadback();
     auto c0 = std::chrono::high_resolution_clock::now();
     bool needsUpdate = false;
     m_profileData.collisionTests = 0;
     m_profileData.collisionHits = 0;
-    for(size_t i = 0; i < m_activeInstanceIndices.size(); ) {
-        uint32_t instIdx = m_activeInstanceIndices[i];
-        InstanceData &instance = m_instances[instIdx];
-        m_profileData.collisionTests++;
-        float foliageRadius = (instance.meshType == 1 || instance.meshType == 2) ? 0.75f : 0.45f;
-        float testRadius = playerRadius + foliageRadius;
-        float dx = playerPos.x - instance.position.x;
-        float dy = playerPos.y - instance.position.y;
-        float dz = playerPos.z - instance.position.z;
-        float distSq = dx*dx + dy*dy + dz*dz;
-        if(distSq < testRadius * testRadius){
-            instance.isActive = false;
-            needsUpdate = true;
-            m_profileData.collisionHits++;
-            // swap-remove this index
-            uint32_t backIdx = m_activeInstanceIndices.back();
-            m_activeInstanceIndices[i] = backIdx;
-            m_activeInstancePositions[backIdx] = (int)i;
-            m_activeInstanceIndices.pop_back();
-            m_activeInstancePositions[instIdx] = -1;
-            continue; // do not advance i, new element at i to test
-        }
-        ++i; // advance only when not removed
+    // Only the cells overlapping the largest possible contact circle are visited
+    float reach = playerRadius + MAX_FOLIAGE_COLLISION_RADIUS;
+    int x0 = collisionCellCoord(playerPos.x - reach, m_collisionGridOrigin.x, m_collisionGridWidth);
+    int x1 = collisionCellCoord(playerPos.x + reach, m_collisionGridOrigin.x, m_collisionGridWidth);
+    int z0 = collisionCellCoord(playerPos.z - reach, m_collisionGridOrigin.y, m_collisionGridDepth);
+    int z1 = collisionCellCoord(playerPos.z + reach, m_collisionGridOrigin.y, m_collisionGridDepth);
+    for(int cz = z0; cz <= z1 && !m_collisionCells.empty(); ++cz) {
+        for(int cx = x0; cx <= x1; ++cx) {
+            std::vector<GLuint> &cell = m_collisionCells[(size_t)cz * m_collisionGridWidth + cx];
+            for(size_t i = 0; i < cell.size(); ) {
+                uint32_t instIdx = cell[i];
+                const InstanceData &instance = m_instances[instIdx];
+                m_profileData.collisionTests++;
+                float testRadius = playerRadius + foliageCollisionRadius(instance.meshType);
+                float dx = playerPos.x - instance.position.x;
+                float dy = playerPos.y - instance.position.y;
+                float dz = playerPos.z - instance.position.z;
+                float distSq = dx*dx + dy*dy + dz*dz;
+                if(distSq < testRadius * testRadius){
+                    needsUpdate = true;
+                    m_profileData.collisionHits++;
+                    removeActiveInstance(instIdx);
+                    m_dirtyMaskWords.push_back(instIdx >> 5);
+                    continue; // do not advance i, new element at i to test
+                }
+                ++i; // advance only when not removed
+            }
+        }
     }
     auto c1 = std::chrono::high_resolution_clock::now();
     using msd = std::chrono::duration<double, std::milli>;
     m_profileData.cpuCollisionLoopMs = std::chrono::duration_cast<msd>(c1 - c0).count();
     double rebuildMs = 0.0;
     if(needsUpdate) {
+        // the next cull() repacks the CPU path; the GPU path only needs the touched mask words
+        m_cullDirty = true;
         auto r0 = std::chrono::high_resolution_clock::now();
-        if(m_gpuCullingEnabled){
-            rebuildSourceInstanceBuffer();
-        } else {
-            setupInstanceBuffers(m_lastPlayerView, m_lastPlayerProjection, m_lastCameraPos);
-        }
+        flushActiveMask();
         auto r1 = std::chrono::high_resolution_clock::now();
         rebuildMs = std::chrono::duration_cast<msd>(r1 - r0).count();
     }
     m_profileData.cpuCollisionRebuildMs = rebuildMs;
 }
 
-bool FoliageRenderer::loadMesh(const std::string& objPath, MeshData& meshData) {
+bool FoliageRenderer::loadMesh(const std::string& objPath, MeshData& meshData, bool upload) {
     Mesh mesh;
     if (!SimpleOBJLoader::loadOBJ(objPath, mesh)) {
         std::cerr << "Failed to load OBJ file: " << objPath << std::endl;
@@ -662,11 +1158,24 @@ bool FoliageRenderer::loadMesh(const std::string& objPath, MeshData& meshData) {
         vertices.push_back(vertex.texCoords.y);
     }
     
+    // Tight AABB from the loader, then a sphere around its center reaching the farthest vertex
+    meshData.boundsMin = mesh.boundsMin;
+    meshData.boundsMax = mesh.boundsMax;
+    meshData.boundingCenter = (meshData.boundsMin + meshData.boundsMax) * 0.5f;
+    float maxDistSq = 0.0f;
+    for(const auto& vertex : mesh.vertices) {
+        glm::vec3 d = vertex.position - meshData.boundingCenter;
+        maxDistSq = std::max(maxDistSq, glm::dot(d, d));
+    }
+    meshData.boundingRadius = std::sqrt(maxDistSq);
+
     meshData.indices = mesh.indices;
     meshData.vertexData = vertices; // store for combined buffer build
     meshData.indexCount = mesh.indices.size();
     meshData.baseVertex = 0;
     meshData.instanceCount = 0; // Initialize to 0, will be set in setupInstanceBuffers
+    meshData.VAO = meshData.VBO = meshData.EBO = 0;
+    if(!upload) return true;
 
     glGenVertexArrays(1, &meshData.VAO);
     glGenBuffers(1, &meshData.VBO);
@@ -697,6 +1206,112 @@ bool FoliageRenderer::loadMesh(const std::string& objPath, MeshData& meshData) {
     return true;
 }
 
+void FoliageRenderer::loadLODChain(const std::string& objPath, MeshData& meshData) {
+    MeshLOD lod0;
+    lod0.indices = meshData.indices;
+    lod0.indexCount = meshData.indexCount;
+    meshData.lods.clear();
+    meshData.lods.push_back(lod0);
+
+    // Coarser levels on disk continue the numbering: grassB.obj -> grassB_lod1.obj, bush01_lod2.obj -> bush01_lod3.obj
+    std::string stem = objPath.substr(0, objPath.size() - 4);
+    int nextLevel = 1;
+    size_t lodPos = stem.rfind("_lod");
+    if(lodPos != std::string::npos && lodPos + 4 < stem.size() &&
+       stem.find_first_not_of("0123456789", lodPos + 4) == std::string::npos) {
+        nextLevel = std::atoi(stem.c_str() + lodPos + 4) + 1;
+        stem = stem.substr(0, lodPos);
+    }
+    while(meshData.lods.size() < MAX_LODS) {
+        std::string lodPath = stem + "_lod" + std::to_string(nextLevel++) + ".obj";
+        if(!std::ifstream(lodPath).good()) break;
+        Mesh mesh;
+        if(!SimpleOBJLoader::loadOBJ(lodPath, mesh)) break;
+        MeshLOD lod;
+        for(const auto& vertex : mesh.vertices) {
+            lod.vertexData.push_back(vertex.position.x);
+            lod.vertexData.push_back(vertex.position.y);
+            lod.vertexData.push_back(vertex.position.z);
+            lod.vertexData.push_back(vertex.normal.x);
+            lod.vertexData.push_back(vertex.normal.y);
+            lod.vertexData.push_back(vertex.normal.z);
+            lod.vertexData.push_back(vertex.texCoords.x);
+            lod.vertexData.push_back(vertex.texCoords.y);
+        }
+        lod.indices = mesh.indices;
+        lod.indexCount = mesh.indices.size();
+        meshData.lods.push_back(lod);
+    }
+
+    // Only one level on disk: derive coarser ones by clustering the LOD0 vertices
+    if(meshData.lods.size() == 1) {
+        const int gridResolutions[MAX_LODS - 1] = {12, 5};
+        for(int i = 0; i < MAX_LODS - 1; i++) {
+            MeshLOD lod;
+            if(!generateSimplifiedLOD(meshData, meshData.lods.back(), gridResolutions[i], lod)) break;
+            meshData.lods.push_back(lod);
+        }
+    }
+
+    std::cout << "LOD chain for " << objPath << ":";
+    for(const auto& lod : meshData.lods) std::cout << " " << lod.indexCount / 3;
+    std::cout << " triangles, ACMR/ATVR";
+    for(const auto& lod : meshData.lods){
+        size_t vertexCount = (lod.vertexData.empty() ? meshData.vertexData.size() : lod.vertexData.size()) / 8;
+        MeshOptimizer::VertexCacheStats stats = MeshOptimizer::analyzeVertexCache(lod.indices, vertexCount);
+        std::cout << " " << stats.acmr << "/" << stats.atvr;
+    }
+    std::cout << std::endl;
+}
+
+// Vertex clustering: snap every vertex to a grid cell, keep one vertex per cell and drop
+// triangles that collapse. The result indexes into the LOD0 vertex data.
+bool FoliageRenderer::generateSimplifiedLOD(const MeshData& meshData, const MeshLOD& source, int gridResolution, MeshLOD& lod) {
+    glm::vec3 extent = meshData.boundsMax - meshData.boundsMin;
+    float cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / (float)gridResolution;
+    if(cellSize <= 0.0f) return false;
+
+    const size_t vertexCount = meshData.vertexData.size() / 8;
+    std::unordered_map<uint64_t, GLuint> cellRepresentative;
+    std::vector<GLuint> remap(vertexCount);
+    for(size_t v = 0; v < vertexCount; v++) {
+        glm::vec3 p(meshData.vertexData[v*8+0], meshData.vertexData[v*8+1], meshData.vertexData[v*8+2]);
+        glm::ivec3 cell = glm::ivec3(glm::floor((p - meshData.boundsMin) / cellSize));
+        uint64_t key = ((uint64_t)(cell.x & 0x1FFFFF)) | ((uint64_t)(cell.y & 0x1FFFFF) << 21) | ((uint64_t)(cell.z & 0x1FFFFF) << 42);
+        remap[v] = cellRepresentative.emplace(key, (GLuint)v).first->second;
+    }
+
+    lod.indices.clear();
+    lod.indices.reserve(source.indices.size());
+    for(size_t i = 0; i + 2 < source.indices.size(); i += 3) {
+        GLuint a = remap[source.indices[i]];
+        GLuint b = remap[source.indices[i+1]];
+        GLuint c = remap[source.indices[i+2]];
+        if(a == b || b == c || a == c) continue;
+        lod.indices.push_back(a);
+        lod.indices.push_back(b);
+        lod.indices.push_back(c);
+    }
+    // Not worth a level if nothing survives or nothing was removed
+    if(lod.indices.empty() || lod.indices.size() >= source.indices.size()) return false;
+    // Collapsing keeps LOD0's triangle order, which no longer suits the cache once vertices merge
+    MeshOptimizer::optimizeVertexCache(lod.indices, vertexCount);
+    MeshOptimizer::optimizeOverdraw(lod.indices, meshData.vertexData.data(), 8, vertexCount);
+    lod.indexCount = lod.indices.size();
+    return true;
+}
+
+int FoliageRenderer::selectLOD(const MeshData& mesh, const glm::vec3& center, const glm::vec3& cameraPos, float lodScale) const {
+    int lastLOD = (int)mesh.lods.size() - 1;
+    if(!m_lodEnabled || lastLOD <= 0) return 0;
+    // Projected sphere radius relative to half the screen height
+    float dist = std::max(glm::length(center - cameraPos), 1e-4f);
+    float screenSize = mesh.boundingRadius * lodScale / dist;
+    int lod = 0;
+    while(lod < lastLOD && screenSize < m_lodScreenSizes[lod]) lod++;
+    return lod;
+}
+
 // Build combined VBO/EBO and setup a single VAO for multi-draw indirect
 void FoliageRenderer::buildCombinedBuffers(){
     if(m_combinedBuilt) return;
@@ -707,14 +1322,24 @@ void FoliageRenderer::buildCombinedBuffers(){
     GLuint vertexOffset = 0;
     for(auto &mesh : m_meshes){
         mesh.baseVertex = vertexOffset / 8;
-        mesh.firstIndex = allIndices.size();
         allVertices.insert(allVertices.end(), mesh.vertexData.begin(), mesh.vertexData.end());
-        // Remap indices
-        for(auto idx : mesh.indices){
-            GLuint remapped = idx + mesh.baseVertex;
-            allIndices.push_back(remapped);
-        }
         vertexOffset += mesh.vertexData.size();
+        for(auto &lod : mesh.lods){
+            // Generated levels index into the LOD0 vertices, loaded ones bring their own
+            GLuint lodBaseVertex = mesh.baseVertex;
+            if(!lod.vertexData.empty()){
+                lodBaseVertex = vertexOffset / 8;
+                allVertices.insert(allVertices.end(), lod.vertexData.begin(), lod.vertexData.end());
+                vertexOffset += lod.vertexData.size();
+            }
+            lod.firstIndex = allIndices.size();
+            // Remap indices
+            for(auto idx : lod.indices){
+                GLuint remapped = idx + lodBaseVertex;
+                allIndices.push_back(remapped);
+            }
+        }
+        mesh.firstIndex = mesh.lods[0].firstIndex;
     }
     glGenVertexArrays(1, &m_combinedVAO);
     glGenBuffers(1, &m_combinedVBO);
@@ -729,105 +1354,486 @@ void FoliageRenderer::buildCombinedBuffers(){
     glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,8*sizeof(float),(void*)(3*sizeof(float))); glEnableVertexAttribArray(1);
     glVertexAttribPointer(2,2,GL_FLOAT,GL_FALSE,8*sizeof(float),(void*)(6*sizeof(float))); glEnableVertexAttribArray(2);
     glBindVertexArray(0);
+
+    // Quantized copy in the same vertex order: positions relative to a per-mesh box
+    // shared by every level, so one pair of uniforms per mesh type decodes them
+    struct QuantizedVertex {
+        GLushort position[4]; // unorm16, w unused
+        GLshort normal[2];    // octahedral, snorm16
+        GLushort texCoords[2]; // half floats
+    };
+    static_assert(sizeof(QuantizedVertex) == 16, "quantized vertex is 16 bytes");
+    std::vector<QuantizedVertex> quantized;
+    quantized.reserve(allVertices.size() / 8);
+    for(auto &mesh : m_meshes){
+        glm::vec3 lo = mesh.boundsMin, hi = mesh.boundsMax;
+        for(const auto &lod : mesh.lods){
+            for(size_t i = 0; i + 7 < lod.vertexData.size(); i += 8){
+                glm::vec3 p(lod.vertexData[i], lod.vertexData[i+1], lod.vertexData[i+2]);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+        }
+        mesh.quantizeMin = lo;
+        mesh.quantizeExtent = glm::max(hi - lo, glm::vec3(1e-6f));
+        auto append = [&](const std::vector<float> &data){
+            for(size_t i = 0; i + 7 < data.size(); i += 8){
+                QuantizedVertex q;
+                glm::vec3 p = glm::clamp((glm::vec3(data[i], data[i+1], data[i+2]) - mesh.quantizeMin) / mesh.quantizeExtent, 0.0f, 1.0f);
+                for(int k = 0; k < 3; k++) q.position[k] = (GLushort)std::lround(p[k] * 65535.0f);
+                q.position[3] = 0;
+                // Project onto the octahedron, folding the lower half over the diagonals
+                glm::vec3 n(data[i+3], data[i+4], data[i+5]);
+                float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+                glm::vec2 e = l1 > 0.0f ? glm::vec2(n.x, n.y) / l1 : glm::vec2(0.0f);
+                if(n.z < 0.0f){
+                    e = glm::vec2((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+                                  (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+                }
+                for(int k = 0; k < 2; k++) q.normal[k] = (GLshort)std::lround(glm::clamp(e[k], -1.0f, 1.0f) * 32767.0f);
+                q.texCoords[0] = glm::packHalf1x16(data[i+6]);
+                q.texCoords[1] = glm::packHalf1x16(data[i+7]);
+                quantized.push_back(q);
+            }
+        };
+        append(mesh.vertexData);
+        for(const auto &lod : mesh.lods) append(lod.vertexData);
+    }
+    glGenVertexArrays(1, &m_quantizedVAO);
+    glGenBuffers(1, &m_quantizedVBO);
+    glBindVertexArray(m_quantizedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quantizedVBO);
+    glBufferData(GL_ARRAY_BUFFER, quantized.size()*sizeof(QuantizedVertex), quantized.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_combinedEBO);
+    glVertexAttribPointer(0,4,GL_UNSIGNED_SHORT,GL_TRUE,sizeof(QuantizedVertex),(void*)offsetof(QuantizedVertex, position)); glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1,2,GL_SHORT,GL_TRUE,sizeof(QuantizedVertex),(void*)offsetof(QuantizedVertex, normal)); glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2,2,GL_HALF_FLOAT,GL_FALSE,sizeof(QuantizedVertex),(void*)offsetof(QuantizedVertex, texCoords)); glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+
+    // Static per-bucket info for build_cmd.comp: indexCount, firstIndex, baseVertex
+    // (indices are already remapped above, so baseVertex stays 0 like updateIndirectBuffer)
+    std::vector<GLuint> meshInfo(commandCount()*3, 0);
+    for(size_t meshType=0; meshType<m_meshes.size(); ++meshType){
+        const auto &mesh = m_meshes[meshType];
+        for(size_t lod=0; lod<mesh.lods.size(); ++lod){
+            size_t bucket = meshType * MAX_LODS + lod;
+            meshInfo[bucket*3+0] = mesh.lods[lod].indexCount;
+            meshInfo[bucket*3+1] = mesh.lods[lod].firstIndex;
+        }
+    }
+    if(m_meshInfoSSBO==0) glGenBuffers(1,&m_meshInfoSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_meshInfoSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, meshInfo.size()*sizeof(GLuint), meshInfo.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     m_combinedBuilt = true;
 }
 
+void FoliageRenderer::bindCombinedVertices(GLuint program){
+    const bool quantized = m_quantizedVerticesEnabled && m_quantizedVAO != 0;
+    glUniform1i(glGetUniformLocation(program, "uQuantized"), quantized ? 1 : 0);
+    if(quantized && !m_meshes.empty()){
+        std::vector<glm::vec3> quantizeMin(m_meshes.size()), quantizeExtent(m_meshes.size());
+        for(size_t i = 0; i < m_meshes.size(); ++i){
+            quantizeMin[i] = m_meshes[i].quantizeMin;
+            quantizeExtent[i] = m_meshes[i].quantizeExtent;
+        }
+        glUniform3fv(glGetUniformLocation(program, "uQuantizeMin"), (GLsizei)m_meshes.size(), glm::value_ptr(quantizeMin[0]));
+        glUniform3fv(glGetUniformLocation(program, "uQuantizeExtent"), (GLsizei)m_meshes.size(), glm::value_ptr(quantizeExtent[0]));
+    }
+    glBindVertexArray(quantized ? m_quantizedVAO : m_combinedVAO);
+}
+
 void FoliageRenderer::updateIndirectBuffer(){
     struct IndirectCommand { GLuint count; GLuint instanceCount; GLuint firstIndex; GLuint baseVertex; GLuint baseInstance; };
     std::vector<IndirectCommand> commands;
-    commands.reserve(m_meshes.size());
+    commands.reserve(commandCount());
 
+    // One command per (mesh, LOD) bucket, missing levels stay empty
     for(auto &mesh : m_meshes){
-        IndirectCommand cmd{};
-        cmd.count = mesh.indexCount;
-        cmd.instanceCount = mesh.instanceCount;
-        cmd.firstIndex = mesh.firstIndex;
-        cmd.baseVertex = 0;
-        cmd.baseInstance = mesh.baseInstance;
-        commands.push_back(cmd);
+        for(size_t lod=0; lod<MAX_LODS; ++lod){
+            IndirectCommand cmd{};
+            if(lod < mesh.lods.size()){
+                cmd.count = mesh.lods[lod].indexCount;
+                cmd.instanceCount = mesh.lods[lod].instanceCount;
+                cmd.firstIndex = mesh.lods[lod].firstIndex;
+                cmd.baseVertex = 0;
+                cmd.baseInstance = mesh.lods[lod].baseInstance;
+            }
+            commands.push_back(cmd);
+        }
     }
     
+    GLsizeiptr cmdBytes = (GLsizeiptr)(commands.size()*sizeof(IndirectCommand));
     if(!m_indirectBuffer) glGenBuffers(1, &m_indirectBuffer);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
-    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size()*sizeof(IndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if(m_indirectBufferSize != cmdBytes){
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, cmdBytes, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        m_indirectBufferSize = cmdBytes;
+    }
+    m_stream.upload(m_indirectBuffer, 0, commands.data(), cmdBytes);
+}
+
+GLuint FoliageRenderer::readVisibleInstanceCount() const {
+    if(!m_indirectBuffer || m_indirectBufferSize == 0) return 0;
+    std::vector<DrawCommand> commands(m_indirectBufferSize / sizeof(DrawCommand));
+    // build_cmd.comp writes the instance counts
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, m_indirectBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, commands.size() * sizeof(DrawCommand), commands.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    GLuint visible = 0;
+    for(const DrawCommand& cmd : commands) visible += cmd.instanceCount;
+    return visible;
 }
 
 void FoliageRenderer::rebuildSourceInstanceBuffer(){
+    flushCollisionReadback();
+    m_sourceDirty = false;
+    // Every instance, active or not, keeps its m_instances index as its source slot
     std::vector<GPUInstancePacked> source;
-    source.reserve(m_activeInstanceIndices.size());
-    m_meshActiveCounts.assign(m_meshes.size(), 0);
-    for(uint32_t instIdx : m_activeInstanceIndices){
-        InstanceData &inst = m_instances[instIdx];
-        GPUInstancePacked packed{};
-        packed.model = inst.modelMatrix;
-        packed.info = glm::vec4((float)inst.textureIndex, (float)inst.meshType,0,0);
-        source.push_back(packed);
-        m_meshActiveCounts[inst.meshType]++;
+    source.reserve(m_instances.size());
+    for(const InstanceData &inst : m_instances){
+        source.push_back(packInstance(inst));
     }
 
     if(m_sourceInstanceSSBO==0) glGenBuffers(1,&m_sourceInstanceSSBO);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sourceInstanceSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, source.size()*sizeof(GPUInstancePacked), source.data(), GL_DYNAMIC_DRAW);
+    // streamed worlds patch slot ranges in place as tiles arrive
+    glBufferData(GL_SHADER_STORAGE_BUFFER, source.size()*sizeof(GPUInstancePacked), source.data(), m_streaming ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    m_sourceInstanceCount = (GLuint)source.size();
+    allocateCullBuffers();
+}
 
-    GLuint totalActive = 0; for(auto c : m_meshActiveCounts) totalActive += c;
-    if(m_instanceSSBO==0) glGenBuffers(1,&m_instanceSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceSSBO);
-    static GLsizeiptr allocated=0;
-    GLsizeiptr req = (GLsizeiptr)totalActive * sizeof(GPUInstancePacked);
+void FoliageRenderer::allocateCullBuffers(){
+    updateBucketCapacities();
 
-    if(req>allocated){ glBufferData(GL_SHADER_STORAGE_BUFFER, req, nullptr, GL_DYNAMIC_DRAW); allocated=req; }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    // Phase 1 can reject at most every source instance
+    if(m_occludedListSSBO==0) glGenBuffers(1,&m_occludedListSSBO);
+    GLsizeiptr occludedReq = (GLsizeiptr)std::max<GLuint>(m_sourceInstanceCount, 1) * sizeof(GLuint);
+    if(occludedReq > m_occludedListSize){
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_occludedListSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, occludedReq, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+        m_occludedListSize = occludedReq;
+    }
+
+    if(m_compactShader){
+        if(m_decisionSSBO==0) glGenBuffers(1,&m_decisionSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_decisionSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)std::max<GLuint>(m_sourceInstanceCount, 1)*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    }
 
     if(m_counterSSBO==0) glGenBuffers(1,&m_counterSSBO);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterSSBO);
-    std::vector<GLuint> zeros(m_meshes.size(),0);
+    std::vector<GLuint> zeros(commandCount(),0);
     glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size()*sizeof(GLuint), zeros.data(), GL_DYNAMIC_DRAW);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+    // Whole mask once per load, later changes go through flushActiveMask
+    if(m_activeMaskSSBO==0) glGenBuffers(1,&m_activeMaskSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_activeMaskSSBO);
+    if(m_activeMask.empty()) m_activeMask.push_back(0);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_activeMask.size()*sizeof(GLuint), m_activeMask.data(), GL_DYNAMIC_DRAW);
+    m_dirtyMaskWords.clear();
+    // the hit list can hold each instance once
+    const GLuint zero = 0;
+    if(m_collisionShader){
+        if(m_collisionHitsSSBO==0) glGenBuffers(1,&m_collisionHitsSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_collisionHitsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(1 + m_sourceInstanceCount)*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    m_collisionHitsApplied = 0;
+    m_lastColliders.clear();
+
+    // Cells plus the visible-cell list (3 dispatch args, then one slot per cell)
+    std::vector<GPUInstanceCell> gpuCells(m_cells.size());
+    for(size_t i=0;i<m_cells.size();++i){
+        gpuCells[i].boundsMin = glm::vec4(m_cells[i].boundsMin, 0.0f);
+        gpuCells[i].boundsMax = glm::vec4(m_cells[i].boundsMax, 0.0f);
+        gpuCells[i].firstInstance = m_cells[i].firstInstance;
+        gpuCells[i].instanceCount = m_cells[i].instanceCount;
+        gpuCells[i].pad[0] = gpuCells[i].pad[1] = 0;
+    }
+    if(m_cellSSBO==0) glGenBuffers(1,&m_cellSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cellSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)std::max<size_t>(gpuCells.size(), 1)*sizeof(GPUInstanceCell), gpuCells.empty() ? nullptr : gpuCells.data(), m_streaming ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    if(m_visibleCellSSBO==0) glGenBuffers(1,&m_visibleCellSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleCellSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(3 + m_cells.size())*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+}
+
+void FoliageRenderer::updateBucketCapacities(){
+    m_meshSourceCounts.assign(m_meshes.size(), 0);
+    for(const auto &cell : m_cells){
+        for(size_t i=0;i<cell.meshCounts.size();++i) m_meshSourceCounts[i] += cell.meshCounts[i];
+    }
+    // Every LOD bucket of a mesh may receive all of its instances
+    GLuint totalCapacity = 0;
+    for(size_t i=0;i<m_meshes.size();++i) totalCapacity += m_meshSourceCounts[i] * (GLuint)m_meshes[i].lods.size();
+    if(m_instanceSSBO==0) glGenBuffers(1,&m_instanceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceSSBO);
+    GLsizeiptr req = (GLsizeiptr)totalCapacity * sizeof(GPUInstancePacked);
+
+    if(req>m_instanceSSBOSize){ glBufferData(GL_SHADER_STORAGE_BUFFER, req, nullptr, GL_DYNAMIC_DRAW); m_instanceSSBOSize=req; }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+}
+
+void FoliageRenderer::dispatchCellCulling(const std::vector<glm::vec4>& frustumPlanes, const glm::vec3& cameraPos){
+    // groups (x, 1, 1) grow from zero as cells survive
+    static const GLuint dispatchReset[3] = {0, 1, 1};
+    m_stream.upload(m_visibleCellSSBO, 0, dispatchReset, sizeof(dispatchReset));
+    glUseProgram(m_cellCullShader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_cellSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_visibleCellSSBO);
+    glUniform4fv(glGetUniformLocation(m_cellCullShader,"uFrustumPlanes"), 6, glm::value_ptr(frustumPlanes[0]));
+    glUniform1ui(glGetUniformLocation(m_cellCullShader,"uCellCount"), (GLuint)m_cells.size());
+    glUniform3fv(glGetUniformLocation(m_cellCullShader,"uPlayerPos"), 1, glm::value_ptr(cameraPos));
+    glUniform1f(glGetUniformLocation(m_cellCullShader,"uCullDistance"), CULL_DISTANCE);
+    glDispatchCompute(((GLuint)m_cells.size() + 63)/64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void FoliageRenderer::flushActiveMask(){
+    if(m_activeMaskSSBO && !m_dirtyMaskWords.empty()){
+        std::sort(m_dirtyMaskWords.begin(), m_dirtyMaskWords.end());
+        m_dirtyMaskWords.erase(std::unique(m_dirtyMaskWords.begin(), m_dirtyMaskWords.end()), m_dirtyMaskWords.end());
+        // one upload per run of adjacent dirty words
+        size_t runStart = 0;
+        for(size_t i = 1; i <= m_dirtyMaskWords.size(); ++i){
+            if(i < m_dirtyMaskWords.size() && m_dirtyMaskWords[i] == m_dirtyMaskWords[i-1] + 1) continue;
+            GLuint first = m_dirtyMaskWords[runStart];
+            GLuint count = m_dirtyMaskWords[i-1] - first + 1;
+            m_stream.upload(m_activeMaskSSBO, (GLintptr)first*sizeof(GLuint), &m_activeMask[first], count*sizeof(GLuint));
+            runStart = i;
+        }
+    }
+    m_dirtyMaskWords.clear();
+}
+
+void FoliageRenderer::dispatchCollisionPass(const std::vector<glm::vec4>& colliders){
+    auto c0 = std::chrono::high_resolution_clock::now();
+    m_profileData.collisionTests = 0;
+    // Hits found by earlier passes arrive here, a few frames late
+    m_profileData.collisionHits = pollCollisionReadback(false);
+    m_profileData.cpuCollisionRebuildMs = 0.0;
+    // A collider that has not moved cannot hit anything new
+    if(colliders != m_lastColliders && !colliders.empty()){
+        GPUProfileScope collisionScope(m_gpuProfiler, "Foliage collision");
+        m_lastColliders = colliders;
+        GLuint colliderCount = (GLuint)std::min<size_t>(colliders.size(), MAX_COLLIDERS);
+        std::vector<float> radii(m_meshes.size());
+        for(size_t i=0;i<m_meshes.size();++i) radii[i] = foliageCollisionRadius((int)i);
+        GLuint total = m_sourceInstanceCount;
+
+        glUseProgram(m_collisionShader);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_sourceInstanceSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_activeMaskSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_collisionHitsSSBO);
+        glUniform1ui(glGetUniformLocation(m_collisionShader,"uTotalInstances"), total);
+        glUniform1ui(glGetUniformLocation(m_collisionShader,"uMeshCount"), (GLuint)m_meshes.size());
+        glUniform1fv(glGetUniformLocation(m_collisionShader,"uFoliageRadii"), (GLsizei)radii.size(), radii.data());
+        glUniform4fv(glGetUniformLocation(m_collisionShader,"uColliders"), (GLsizei)colliderCount, glm::value_ptr(colliders[0]));
+        glUniform1ui(glGetUniformLocation(m_collisionShader,"uColliderCount"), colliderCount);
+        glDispatchCompute((total + 127)/128, 1, 1);
+        // the hit counter and list are read back with glCopyBufferSubData
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        m_profileData.collisionTests = total;
+        m_collisionReadbackRequested = true;
+        m_cullDirty = true;
+    }
+    auto c1 = std::chrono::high_resolution_clock::now();
+    using msd = std::chrono::duration<double, std::milli>;
+    m_profileData.cpuCollisionLoopMs = std::chrono::duration_cast<msd>(c1 - c0).count();
+}
+
+GLuint FoliageRenderer::pollCollisionReadback(bool wait){
+    GLuint applied = 0;
+    if(m_collisionHitsFence){
+        GLenum status = glClientWaitSync(m_collisionHitsFence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 0);
+        while(wait && status == GL_TIMEOUT_EXPIRED){
+            status = glClientWaitSync(m_collisionHitsFence, 0, 1000000);
+        }
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return 0;
+        glDeleteSync(m_collisionHitsFence);
+        m_collisionHitsFence = 0;
+
+        GLuint hitCount = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, m_collisionHitsReadback);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &hitCount);
+        GLuint fetched = std::min(hitCount - m_collisionHitsApplied, COLLISION_READBACK_WINDOW);
+        std::vector<GLuint> hits(fetched);
+        if(fetched) glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(GLuint), fetched*sizeof(GLuint), hits.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        // the GPU already cleared these bits, only the CPU copy changes
+        for(GLuint instIdx : hits){
+            if(m_instances[instIdx].isActive){
+                removeActiveInstance(instIdx);
+                applied++;
+            }
+        }
+        m_collisionHitsApplied += fetched;
+        // more hits than one window holds: keep reading
+        if(m_collisionHitsApplied < hitCount) m_collisionReadbackRequested = true;
+    }
+    if(!m_collisionHitsFence && m_collisionReadbackRequested){
+        // counter plus the next window of unread hit indices
+        GLuint window = std::min<GLuint>(m_sourceInstanceCount - m_collisionHitsApplied, COLLISION_READBACK_WINDOW);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_collisionHitsSSBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_collisionHitsReadback);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        if(window) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                       (GLintptr)(1 + m_collisionHitsApplied)*sizeof(GLuint), sizeof(GLuint), window*sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_collisionHitsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_collisionReadbackRequested = false;
+    }
+    return applied;
+}
+
+void FoliageRenderer::flushCollisionReadback(){
+    // Blocking; only used before the source slots are reassigned
+    while(m_collisionHitsFence || m_collisionReadbackRequested){
+        pollCollisionReadback(true);
+    }
+}
+
+void FoliageRenderer::resetCollisionHits(){
+    // Only valid once every hit has been applied (flushCollisionReadback)
+    m_collisionHitsApplied = 0;
+    m_lastColliders.clear();
+    if(!m_collisionHitsSSBO) return;
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_collisionHitsSSBO);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void FoliageRenderer::dispatchComputeCulling(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos){
     if(!m_frustumCullingShader) return;
     auto t0 = std::chrono::high_resolution_clock::now();
-    // Reset per-mesh visible counters
+    // Reset per-mesh visible counters (cleared on the GPU, no client data)
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterSSBO);
-    std::vector<GLuint> zeroCounters(m_meshes.size(), 0);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, zeroCounters.size()*sizeof(GLuint), zeroCounters.data());
+    const GLuint zero = 0;
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // Compute baseOffsets & capacities
-    std::vector<GLuint> baseOffsets(m_meshes.size(),0);
-    std::vector<GLuint> capacities(m_meshes.size(),0);
+    // Compute baseOffsets & capacities per (mesh, LOD) bucket
+    std::vector<GLuint> baseOffsets(commandCount(),0);
+    std::vector<GLuint> capacities(commandCount(),0);
+    std::vector<GLuint> lodCounts(m_meshes.size(),0);
     GLuint running = 0;
     for(size_t i=0;i<m_meshes.size();++i){
-        baseOffsets[i] = running;
-        capacities[i] = m_meshActiveCounts[i];
-        running += m_meshActiveCounts[i];
+        lodCounts[i] = (GLuint)m_meshes[i].lods.size();
+        for(size_t lod=0; lod<m_meshes[i].lods.size(); ++lod){
+            baseOffsets[i*MAX_LODS + lod] = running;
+            capacities[i*MAX_LODS + lod] = m_meshSourceCounts[i];
+            running += m_meshSourceCounts[i];
+        }
     }
 
+    // Normalized planes and view-projection are computed once here instead of per thread
+    glm::mat4 viewProjection = projection * view;
+    std::vector<glm::vec4> frustumPlanes = extractFrustumPlanes(viewProjection);
+    // First level: cells; the instance pass then runs one workgroup per surviving cell
+    const bool cellCulling = usesCellCulling();
+    if(cellCulling) dispatchCellCulling(frustumPlanes, cameraPos);
+
     glUseProgram(m_frustumCullingShader);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_sourceInstanceSSBO);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_instanceSSBO);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_counterSSBO);
-    GLuint total = 0; for(auto c: m_meshActiveCounts) total += c;
-    glUniformMatrix4fv(glGetUniformLocation(m_frustumCullingShader,"uView"),1,GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(m_frustumCullingShader,"uProj"),1,GL_FALSE, glm::value_ptr(projection));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_activeMaskSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_cellSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_visibleCellSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_decisionSSBO);
+    glUniform1i(glGetUniformLocation(m_frustumCullingShader,"uCellCulling"), cellCulling ? 1 : 0);
+    glUniform1i(glGetUniformLocation(m_frustumCullingShader,"uDeterministic"), usesDeterministicCompaction() ? 1 : 0);
+    GLuint total = m_sourceInstanceCount;
+    glUniform4fv(glGetUniformLocation(m_frustumCullingShader,"uFrustumPlanes"), 6, glm::value_ptr(frustumPlanes[0]));
+    glUniformMatrix4fv(glGetUniformLocation(m_frustumCullingShader,"uViewProj"),1,GL_FALSE, glm::value_ptr(viewProjection));
+    // Per-mesh local bounding spheres: xyz = center, w = radius
+    std::vector<glm::vec4> meshBounds(m_meshes.size());
+    for(size_t i=0;i<m_meshes.size();++i){
+        meshBounds[i] = glm::vec4(m_meshes[i].boundingCenter, m_meshes[i].boundingRadius);
+    }
+    glUniform4fv(glGetUniformLocation(m_frustumCullingShader,"uMeshBounds"), (GLsizei)meshBounds.size(), glm::value_ptr(meshBounds[0]));
     glUniform1ui(glGetUniformLocation(m_frustumCullingShader,"uTotalInstances"), total);
     glUniform1ui(glGetUniformLocation(m_frustumCullingShader,"uMeshCount"), (GLuint)m_meshes.size());
+    glUniform1uiv(glGetUniformLocation(m_frustumCullingShader,"uLodCounts"), (GLsizei)lodCounts.size(), lodCounts.data());
+    glUniform1ui(glGetUniformLocation(m_frustumCullingShader,"uLodStride"), (GLuint)MAX_LODS);
+    glUniform1fv(glGetUniformLocation(m_frustumCullingShader,"uLodScreenSizes"), MAX_LODS - 1, m_lodScreenSizes);
+    glUniform1f(glGetUniformLocation(m_frustumCullingShader,"uLodScale"), projection[1][1]);
+    glUniform1i(glGetUniformLocation(m_frustumCullingShader,"uLodEnabled"), m_lodEnabled ? 1 : 0);
     glUniform3fv(glGetUniformLocation(m_frustumCullingShader,"uPlayerPos"),1, glm::value_ptr(cameraPos));
-    glUniform1f(glGetUniformLocation(m_frustumCullingShader,"uCullDistance"), 100.0f);
+    glUniform1f(glGetUniformLocation(m_frustumCullingShader,"uCullDistance"), CULL_DISTANCE);
     // Upload baseOffsets & capacities arrays
     GLint baseLoc = glGetUniformLocation(m_frustumCullingShader, "uBaseOffsets");
-    if(baseLoc >= 0) glUniform1uiv(baseLoc, (GLsizei)m_meshes.size(), baseOffsets.data());
+    if(baseLoc >= 0) glUniform1uiv(baseLoc, (GLsizei)baseOffsets.size(), baseOffsets.data());
     GLint capLoc = glGetUniformLocation(m_frustumCullingShader, "uCapacities");
-    if(capLoc >= 0) glUniform1uiv(capLoc, (GLsizei)m_meshes.size(), capacities.data());
-    GLuint groups = (total + 127)/128;
-    glDispatchCompute(groups,1,1);
+    if(capLoc >= 0) glUniform1uiv(capLoc, (GLsizei)capacities.size(), capacities.data());
+    const bool occlusion = usesOcclusionCulling();
+    glUniform1ui(glGetUniformLocation(m_frustumCullingShader,"uPhase"), occlusion ? 1u : 0u);
+    if(occlusion){
+        // Phase 1 tests against the pyramid left by the previous cull
+        static const GLuint statsReset[6] = {0, 1, 1, 0, 0, 0};
+        m_stream.upload(m_occlusionStatsSSBO, 0, statsReset, sizeof(statsReset));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_occlusionStatsSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_occludedListSSBO);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+        glUniform1i(glGetUniformLocation(m_frustumCullingShader,"uHiZ"), 1);
+        glUniform1i(glGetUniformLocation(m_frustumCullingShader,"uHiZValid"), m_hizValid ? 1 : 0);
+        glUniform2f(glGetUniformLocation(m_frustumCullingShader,"uHiZSize"), (float)HIZ_SIZE, (float)HIZ_SIZE);
+        glUniform1f(glGetUniformLocation(m_frustumCullingShader,"uHiZMaxLevel"), (float)(m_hizLevels - 1));
+    }
+    if(cellCulling){
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_visibleCellSSBO);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    } else {
+        GLuint groups = (total + 127)/128;
+        glDispatchCompute(groups,1,1);
+    }
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if(usesDeterministicCompaction()){
+        compactVisibleInstances(baseOffsets, capacities);
+    }
+    if(occlusion){
+        GPUProfileScope occlusionScope(m_gpuProfiler, "Foliage occlusion");
+        runOcclusionPhase2(view, projection, baseOffsets, capacities);
+    }
+    if(m_frontToBackSortEnabled && m_sortShader){
+        GPUProfileScope sortScope(m_gpuProfiler, "Foliage sort");
+        dispatchFrontToBackSort(cameraPos, baseOffsets, capacities, running);
+    }
+    using msd = std::chrono::duration<double, std::milli>;
+    if(usesGPUCommandBuild()){
+        // Counters stay on the GPU: build_cmd.comp turns them into draw commands
+        {
+            GPUProfileScope commandScope(m_gpuProfiler, "Foliage commands");
+            buildIndirectCommandsGPU(baseOffsets, capacities);
+        }
+        for(size_t i=0;i<m_meshes.size();++i){
+            m_meshes[i].baseInstance = baseOffsets[i*MAX_LODS];
+            for(size_t lod=0; lod<m_meshes[i].lods.size(); ++lod){
+                m_meshes[i].lods[lod].baseInstance = baseOffsets[i*MAX_LODS + lod];
+            }
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        m_profileData.cpuDispatchMs = std::chrono::duration_cast<msd>(t1 - t0).count();
+        m_profileData.cpuReadbackMs = 0.0;
+        m_profileData.cpuReorderMs = 0.0;
+        return;
+    }
     auto t1 = std::chrono::high_resolution_clock::now();
     // Read back visible counts
-    std::vector<GLuint> counts(m_meshes.size(),0);
+    std::vector<GLuint> counts(commandCount(),0);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterSSBO);
     glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,0, counts.size()*sizeof(GLuint), counts.data());
     glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
@@ -835,12 +1841,652 @@ void FoliageRenderer::dispatchComputeCulling(const glm::mat4& view, const glm::m
     // Assign baseInstance (from prefix) & instanceCount (visible)
     running = 0;
     for(size_t i=0;i<m_meshes.size();++i){
-        m_meshes[i].baseInstance = baseOffsets[i];
-        m_meshes[i].instanceCount = counts[i];
+        auto &mesh = m_meshes[i];
+        mesh.baseInstance = baseOffsets[i*MAX_LODS];
+        mesh.instanceCount = 0;
+        for(size_t lod=0; lod<mesh.lods.size(); ++lod){
+            size_t bucket = i*MAX_LODS + lod;
+            mesh.lods[lod].baseInstance = baseOffsets[bucket];
+            mesh.lods[lod].instanceCount = std::min(counts[bucket], capacities[bucket]);
+            mesh.instanceCount += mesh.lods[lod].instanceCount;
+        }
     }
     auto t3 = std::chrono::high_resolution_clock::now();
-    using msd = std::chrono::duration<double, std::milli>;
     m_profileData.cpuDispatchMs = std::chrono::duration_cast<msd>(t1 - t0).count();
     m_profileData.cpuReadbackMs = std::chrono::duration_cast<msd>(t2 - t1).count();
     m_profileData.cpuReorderMs = 0.0; // eliminated CPU reorder
 }
+
+void FoliageRenderer::buildIndirectCommandsGPU(const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities){
+    // Indirect buffer keeps a fixed size, so it is only allocated once
+    GLsizeiptr cmdBytes = (GLsizeiptr)(commandCount()*sizeof(DrawCommand));
+    if(!m_indirectBuffer) glGenBuffers(1, &m_indirectBuffer);
+    if(m_indirectBufferSize != cmdBytes){
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, cmdBytes, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        m_indirectBufferSize = cmdBytes;
+    }
+
+    glUseProgram(m_instanceUpdateShader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_counterSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_meshInfoSSBO);
+    glUniform1ui(glGetUniformLocation(m_instanceUpdateShader,"uCommandCount"), commandCount());
+    GLint baseLoc = glGetUniformLocation(m_instanceUpdateShader, "uBaseOffsets");
+    if(baseLoc >= 0) glUniform1uiv(baseLoc, (GLsizei)baseOffsets.size(), baseOffsets.data());
+    GLint capLoc = glGetUniformLocation(m_instanceUpdateShader, "uCapacities");
+    if(capLoc >= 0) glUniform1uiv(capLoc, (GLsizei)capacities.size(), capacities.data());
+    glDispatchCompute(1,1,1);
+    // Commands are consumed by glMultiDrawElementsIndirect
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void FoliageRenderer::compactVisibleInstances(const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities){
+    // Groups match the cull pass: cells when cell culling ran, 128-instance workgroups otherwise
+    const bool cellCulling = usesCellCulling();
+    const GLuint groupCount = cellCulling ? (GLuint)m_cells.size() : (m_sourceInstanceCount + 127) / 128;
+    if(groupCount == 0) return;
+    if(m_groupCountSSBO==0) glGenBuffers(1,&m_groupCountSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_groupCountSSBO);
+    GLsizeiptr groupBytes = (GLsizeiptr)groupCount * commandCount() * sizeof(GLuint);
+    if(groupBytes > m_groupCountSize){
+        glBufferData(GL_SHADER_STORAGE_BUFFER, groupBytes, nullptr, GL_DYNAMIC_COPY);
+        m_groupCountSize = groupBytes;
+    }
+    if(cellCulling){
+        // Cells the cell pass rejected are never counted and must scan as empty
+        const GLuint zero = 0;
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(m_compactShader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_sourceInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_instanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_counterSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_cellSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_visibleCellSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_decisionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, m_groupCountSSBO);
+    glUniform1i(glGetUniformLocation(m_compactShader,"uCellCulling"), cellCulling ? 1 : 0);
+    glUniform1ui(glGetUniformLocation(m_compactShader,"uTotalInstances"), m_sourceInstanceCount);
+    glUniform1ui(glGetUniformLocation(m_compactShader,"uBucketCount"), commandCount());
+    glUniform1ui(glGetUniformLocation(m_compactShader,"uGroupCount"), groupCount);
+    glUniform1uiv(glGetUniformLocation(m_compactShader,"uBaseOffsets"), (GLsizei)baseOffsets.size(), baseOffsets.data());
+    glUniform1uiv(glGetUniformLocation(m_compactShader,"uCapacities"), (GLsizei)capacities.size(), capacities.data());
+    GLint stepLoc = glGetUniformLocation(m_compactShader,"uStep");
+    for(GLuint step = 0; step < 3; ++step){
+        glUniform1ui(stepLoc, step);
+        if(step == 1){
+            glDispatchCompute(commandCount(),1,1); // one workgroup per bucket
+        } else if(cellCulling){
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_visibleCellSSBO);
+            glDispatchComputeIndirect(0);
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        } else {
+            glDispatchCompute(groupCount,1,1);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+void FoliageRenderer::dispatchFrontToBackSort(const glm::vec3& cameraPos, const std::vector<GLuint>& baseOffsets,
+                                              const std::vector<GLuint>& capacities, GLuint totalCapacity){
+    if(totalCapacity == 0) return;
+    if(m_sortScratchSSBO==0) glGenBuffers(1,&m_sortScratchSSBO);
+    if(m_sortScratchSize < m_instanceSSBOSize){
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sortScratchSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_instanceSSBOSize, nullptr, GL_DYNAMIC_COPY);
+        m_sortScratchSize = m_instanceSSBOSize;
+    }
+    if(m_sortBinsSSBO==0){
+        glGenBuffers(1,&m_sortBinsSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sortBinsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)16*SORT_BINS*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sortBinsSSBO);
+    const GLuint zero = 0;
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(m_sortShader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_instanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_counterSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_sortScratchSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_sortBinsSSBO);
+    glUniform1ui(glGetUniformLocation(m_sortShader,"uBucketCount"), commandCount());
+    glUniform1ui(glGetUniformLocation(m_sortShader,"uTotalCapacity"), totalCapacity);
+    glUniform1uiv(glGetUniformLocation(m_sortShader,"uBaseOffsets"), (GLsizei)baseOffsets.size(), baseOffsets.data());
+    glUniform1uiv(glGetUniformLocation(m_sortShader,"uCapacities"), (GLsizei)capacities.size(), capacities.data());
+    glUniform3fv(glGetUniformLocation(m_sortShader,"uPlayerPos"), 1, glm::value_ptr(cameraPos));
+    glUniform1f(glGetUniformLocation(m_sortShader,"uCullDistance"), CULL_DISTANCE);
+    GLint passLoc = glGetUniformLocation(m_sortShader,"uPass");
+    const GLuint groups = (totalCapacity + 255) / 256;
+    glUniform1ui(passLoc, 0u);
+    glDispatchCompute(groups,1,1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1ui(passLoc, 1u);
+    glDispatchCompute(commandCount(),1,1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1ui(passLoc, 2u);
+    glDispatchCompute(groups,1,1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void FoliageRenderer::readOverdrawQueries(){
+    // Oldest first; stop at the first result that is not ready so nothing ever waits
+    for(int i = 0; i < OVERDRAW_QUERY_FRAMES; ++i){
+        int query = (m_overdrawQueryNext + i) % OVERDRAW_QUERY_FRAMES;
+        if(!m_overdrawQueryPending[query]) continue;
+        GLuint shadedReady = 0, passedReady = 0;
+        glGetQueryObjectuiv(m_overdrawQueries[query][0], GL_QUERY_RESULT_AVAILABLE, &shadedReady);
+        glGetQueryObjectuiv(m_overdrawQueries[query][1], GL_QUERY_RESULT_AVAILABLE, &passedReady);
+        if(!shadedReady || !passedReady) return;
+        glGetQueryObjectui64v(m_overdrawQueries[query][0], GL_QUERY_RESULT, &m_profileData.fragmentsShaded);
+        glGetQueryObjectui64v(m_overdrawQueries[query][1], GL_QUERY_RESULT, &m_profileData.samplesPassed);
+        m_overdrawQueryPending[query] = false;
+    }
+}
+
+void FoliageRenderer::initializeOcclusionCulling(){
+    const std::string hizSrc = ShaderCodeLoader::loadShaderCode("shaders/hiz_build.comp");
+    m_hizBuildShader = createComputeShader(hizSrc);
+    if(!m_hizBuildShader){
+        std::cerr << "Hi-Z build compute shader failed, occlusion culling disabled" << std::endl;
+        return;
+    }
+    m_hizLevels = 1 + static_cast<int>(std::floor(std::log2(HIZ_SIZE)));
+
+    // Depth-only target the phase 1 survivors are rendered into
+    glGenTextures(1, &m_occlusionDepthTex);
+    glBindTexture(GL_TEXTURE_2D, m_occlusionDepthTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, HIZ_SIZE, HIZ_SIZE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLint prevFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+    glGenFramebuffers(1, &m_occlusionFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_occlusionFBO);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_occlusionDepthTex, 0);
+    glDrawBuffer(GL_NONE);
+    if(glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+        std::cerr << "Occlusion framebuffer incomplete, occlusion culling disabled" << std::endl;
+        glDeleteProgram(m_hizBuildShader);
+        m_hizBuildShader = 0;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prevFBO);
+
+    // Max-depth pyramid, sampled per level with nearest filtering
+    glGenTextures(1, &m_hizTexture);
+    glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+    glTexStorage2D(GL_TEXTURE_2D, m_hizLevels, GL_R32F, HIZ_SIZE, HIZ_SIZE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &m_occlusionStatsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_occlusionStatsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 6*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &m_occlusionStatsReadback);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_occlusionStatsReadback);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 6*sizeof(GLuint), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void FoliageRenderer::runOcclusionPhase2(const glm::mat4& view, const glm::mat4& projection,
+                                         const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities){
+    // Phase 1 survivors are this frame's occluders
+    buildIndirectCommandsGPU(baseOffsets, capacities);
+    renderOcclusionDepth(view, projection);
+    buildHiZPyramid();
+
+    // Phase 2: re-test only the rejected set against the fresh pyramid, appending to the same ranges
+    glUseProgram(m_frustumCullingShader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_sourceInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_instanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_counterSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_occlusionStatsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_occludedListSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_activeMaskSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_decisionSSBO);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+    glUniform1ui(glGetUniformLocation(m_frustumCullingShader,"uPhase"), 2u);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_occlusionStatsSSBO);
+    glDispatchComputeIndirect(0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // Recovered instances only flipped their decisions: compact the whole set again
+    if(usesDeterministicCompaction()){
+        compactVisibleInstances(baseOffsets, capacities);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    m_hizValid = true;
+
+    readOcclusionStats();
+}
+
+void FoliageRenderer::renderOcclusionDepth(const glm::mat4& view, const glm::mat4& projection){
+    GLint prevViewport[4];
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+    GLint prevFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_occlusionFBO);
+    glViewport(0, 0, HIZ_SIZE, HIZ_SIZE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Same program as the main pass so alpha-tested grass writes matching depth
+    glUseProgram(m_renderShader);
+    glUniformMatrix4fv(glGetUniformLocation(m_renderShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(m_renderShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(m_renderShader, "mipBias"), 0.0f);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureArray);
+    glUniform1i(glGetUniformLocation(m_renderShader, "textureArray"), 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceSSBO);
+    bindCombinedVertices(m_renderShader);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)commandCount(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prevFBO);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+}
+
+void FoliageRenderer::buildHiZPyramid(){
+    glUseProgram(m_hizBuildShader);
+    GLint levelLoc = glGetUniformLocation(m_hizBuildShader, "uLevel");
+    GLint sizeLoc = glGetUniformLocation(m_hizBuildShader, "uDstSize");
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_occlusionDepthTex);
+    glUniform1i(glGetUniformLocation(m_hizBuildShader, "uDepth"), 1);
+    int size = HIZ_SIZE;
+    for(int level = 0; level < m_hizLevels; ++level){
+        glUniform1i(levelLoc, level);
+        glUniform2i(sizeLoc, size, size);
+        if(level > 0) glBindImageTexture(0, m_hizTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, m_hizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((size + 7) / 8, (size + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        size = std::max(1, size / 2);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void FoliageRenderer::readOcclusionStats(){
+    // Never waits: pick up the previous copy only once its fence has signaled
+    if(m_occlusionStatsFence){
+        GLenum status = glClientWaitSync(m_occlusionStatsFence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+        GLuint stats[6] = {0};
+        glBindBuffer(GL_COPY_READ_BUFFER, m_occlusionStatsReadback);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(stats), stats);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        m_profileData.occlusionVisible = stats[5] + stats[4];
+        m_profileData.occlusionOccluded = stats[3] - stats[4];
+        m_profileData.occlusionRecovered = stats[4];
+        glDeleteSync(m_occlusionStatsFence);
+        m_occlusionStatsFence = 0;
+    }
+    // Both phases wrote the stats from the shader
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, m_occlusionStatsSSBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_occlusionStatsReadback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 6*sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_occlusionStatsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool FoliageRenderer::loadTiledWorld(const std::string& manifestPath){
+    SpatialSampleTileSet tileSet;
+    if(!SpatialSampleLoader::loadTileManifest(manifestPath, tileSet)) return false;
+    cancelSampleLoad();
+    stopStreaming();
+
+    m_tileSize = tileSet.tileSize;
+    m_tiles.clear();
+    int maxSamples = 0;
+    glm::vec2 minXZ(std::numeric_limits<float>::max());
+    glm::vec2 maxXZ(-std::numeric_limits<float>::max());
+    for(const auto &info : tileSet.tiles){
+        StreamedTile tile;
+        tile.info = info;
+        m_tiles.push_back(tile);
+        maxSamples = std::max(maxSamples, info.sampleCount);
+        minXZ = glm::min(minXZ, glm::vec2((float)info.x, (float)info.z) * m_tileSize);
+        maxXZ = glm::max(maxXZ, glm::vec2((float)(info.x + 1), (float)(info.z + 1)) * m_tileSize);
+    }
+    m_tileSlotCapacity = ((GLuint)maxSamples + 31u) & ~31u;
+
+    // Every slot starts empty; inactive entries are never culled or drawn
+    size_t poolSize = (size_t)TILE_POOL_SLOTS * m_tileSlotCapacity;
+    beginInstanceSet(poolSize);
+    InstanceData empty = InstanceData();
+    empty.modelMatrix = glm::mat4(1.0f);
+    empty.isActive = false;
+    m_instances.assign(poolSize, empty);
+    m_cells.assign(TILE_POOL_SLOTS, InstanceCell());
+    for(size_t slot = 0; slot < m_cells.size(); ++slot){
+        m_cells[slot].firstInstance = (GLuint)slot * m_tileSlotCapacity;
+        m_cells[slot].instanceCount = 0;
+        computeCellBounds(m_cells[slot], m_instances);
+    }
+    m_slotTiles.assign(TILE_POOL_SLOTS, -1);
+    buildCollisionGrid(minXZ, maxXZ);
+
+    m_streaming = true;
+    m_streamThread = std::thread(&FoliageRenderer::streamWorker, this);
+    std::cout << "Streaming " << m_tiles.size() << " tiles through " << TILE_POOL_SLOTS
+              << " pool slots of " << m_tileSlotCapacity << " instances" << std::endl;
+    return true;
+}
+
+void FoliageRenderer::stopStreaming(){
+    if(m_streamThread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(m_streamMutex);
+            m_streamStop = true;
+        }
+        m_streamCondition.notify_all();
+        m_streamThread.join();
+    }
+    m_streamStop = false;
+    m_streamRequests.clear();
+    m_streamResults.clear();
+    m_readyTiles.clear();
+    m_streaming = false;
+}
+
+void FoliageRenderer::streamWorker(){
+    for(;;){
+        int tileIndex;
+        {
+            std::unique_lock<std::mutex> lock(m_streamMutex);
+            m_streamCondition.wait(lock, [this]{ return m_streamStop || !m_streamRequests.empty(); });
+            if(m_streamStop) return;
+            tileIndex = m_streamRequests.front();
+            m_streamRequests.pop_front();
+        }
+        // m_tiles is only replaced while this thread is stopped, and info is never written
+        const SpatialSampleTile &info = m_tiles[tileIndex].info;
+        LoadedTile loaded;
+        loaded.tileIndex = tileIndex;
+        MappedSS2File samples;
+        if(samples.open(info.path)){
+            // Seeded per tile so a tile looks the same every time it streams back in
+            std::mt19937 rng((unsigned)info.x * 73856093u ^ (unsigned)info.z * 19349663u);
+            std::uniform_real_distribution<float> randVal(0.0f, 1.0f);
+            loaded.instances.reserve(samples.size());
+            for(const auto &sample : samples) loaded.instances.push_back(makeInstance(sample, randVal(rng)));
+        }
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        m_streamResults.push_back(std::move(loaded));
+    }
+}
+
+float FoliageRenderer::tileDistance(const StreamedTile& tile, const glm::vec3& playerPos) const {
+    // XZ distance from the player to the nearest point of the tile
+    glm::vec2 tileMin = glm::vec2((float)tile.info.x, (float)tile.info.z) * m_tileSize;
+    glm::vec2 p(playerPos.x, playerPos.z);
+    glm::vec2 d = glm::max(glm::max(tileMin - p, p - (tileMin + glm::vec2(m_tileSize))), glm::vec2(0.0f));
+    return glm::length(d);
+}
+
+void FoliageRenderer::updateStreaming(const glm::vec3& playerPos){
+    if(!m_streaming) return;
+    m_profileData.streamUploadBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        for(auto &loaded : m_streamResults) m_readyTiles.push_back(std::move(loaded));
+        m_streamResults.clear();
+    }
+
+    // Evict first so freed slots can take this frame's arrivals
+    float evictDistance = m_streamingRadius * TILE_EVICT_MARGIN;
+    std::vector<int> evictions;
+    for(int tileIndex : m_slotTiles){
+        if(tileIndex >= 0 && tileDistance(m_tiles[tileIndex], playerPos) > evictDistance) evictions.push_back(tileIndex);
+    }
+    if(!evictions.empty()){
+        // Hits still on the GPU name pool entries that are about to be reused
+        flushCollisionReadback();
+        for(int tileIndex : evictions) evictTile(tileIndex);
+        resetCollisionHits();
+    }
+
+    std::vector<int> freeSlots;
+    for(int slot = TILE_POOL_SLOTS - 1; slot >= 0; --slot){
+        if(m_slotTiles[slot] < 0) freeSlots.push_back(slot);
+    }
+    int installs = 0;
+    for(size_t i = 0; i < m_readyTiles.size(); ){
+        StreamedTile &tile = m_tiles[m_readyTiles[i].tileIndex];
+        bool wanted = tileDistance(tile, playerPos) <= evictDistance;
+        if(wanted && (freeSlots.empty() || installs >= MAX_TILE_INSTALLS_PER_FRAME)){
+            ++i; // keep for a later frame
+            continue;
+        }
+        if(wanted){
+            installTile(m_readyTiles[i], freeSlots.back());
+            freeSlots.pop_back();
+            installs++;
+        }
+        tile.pending = false;
+        m_readyTiles.erase(m_readyTiles.begin() + i);
+    }
+    if(installs > 0) m_lastColliders.clear(); // new instances may already touch a collider
+    if((installs > 0 || !evictions.empty()) && m_sourceInstanceSSBO && !m_sourceDirty) updateBucketCapacities();
+
+    // Queue the nearest missing tiles, never more than the pool can take
+    GLuint resident = 0, pending = 0;
+    for(const auto &tile : m_tiles){
+        if(tile.slot >= 0) resident++;
+        if(tile.pending) pending++;
+    }
+    std::vector<std::pair<float, int>> missing;
+    for(size_t i = 0; i < m_tiles.size(); ++i){
+        if(m_tiles[i].slot >= 0 || m_tiles[i].pending) continue;
+        float distance = tileDistance(m_tiles[i], playerPos);
+        if(distance <= m_streamingRadius) missing.push_back(std::make_pair(distance, (int)i));
+    }
+    std::sort(missing.begin(), missing.end());
+    {
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        // Requests the player has moved away from are dropped before the worker reaches them
+        for(auto it = m_streamRequests.begin(); it != m_streamRequests.end(); ){
+            if(tileDistance(m_tiles[*it], playerPos) > evictDistance){
+                m_tiles[*it].pending = false;
+                pending--;
+                it = m_streamRequests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        int budget = TILE_POOL_SLOTS - (int)(resident + pending);
+        for(size_t i = 0; i < missing.size() && (int)i < budget; ++i){
+            m_tiles[missing[i].second].pending = true;
+            m_streamRequests.push_back(missing[i].second);
+            pending++;
+        }
+    }
+    m_streamCondition.notify_one();
+
+    m_profileData.streamResidentTiles = resident;
+    m_profileData.streamPendingTiles = pending;
+    m_profileData.streamPoolInstances = 0;
+    for(int tileIndex : m_slotTiles){
+        if(tileIndex >= 0) m_profileData.streamPoolInstances += m_cells[m_tiles[tileIndex].slot].instanceCount;
+    }
+    m_profileData.streamPoolCapacity = (GLuint)m_instances.size();
+}
+
+void FoliageRenderer::installTile(LoadedTile& loaded, int slot){
+    InstanceCell &cell = m_cells[slot];
+    m_cullSpheresDirty = true;
+    GLuint count = (GLuint)std::min<size_t>(loaded.instances.size(), m_tileSlotCapacity);
+    for(GLuint i = 0; i < count; ++i){
+        GLuint instIdx = cell.firstInstance + i;
+        m_instances[instIdx] = loaded.instances[i];
+        addActiveInstance(instIdx);
+    }
+    cell.instanceCount = count;
+    computeCellBounds(cell, m_instances);
+    m_tiles[loaded.tileIndex].slot = slot;
+    m_slotTiles[slot] = loaded.tileIndex;
+    m_cullDirty = true;
+
+    // Not yet on the GPU: the first rebuild uploads the whole pool
+    if(!m_sourceInstanceSSBO || m_sourceDirty) return;
+    std::vector<GPUInstancePacked> packed(count);
+    for(GLuint i = 0; i < count; ++i) packed[i] = packInstance(m_instances[cell.firstInstance + i]);
+    GLsizeiptr sourceBytes = (GLsizeiptr)count * sizeof(GPUInstancePacked);
+    m_stream.upload(m_sourceInstanceSSBO, (GLintptr)cell.firstInstance * sizeof(GPUInstancePacked), packed.data(), sourceBytes);
+    GLuint firstWord = cell.firstInstance >> 5;
+    GLsizeiptr maskBytes = (GLsizeiptr)((count + 31) / 32) * sizeof(GLuint);
+    m_stream.upload(m_activeMaskSSBO, (GLintptr)firstWord * sizeof(GLuint), &m_activeMask[firstWord], maskBytes);
+    uploadCell(slot);
+    m_profileData.streamUploadBytes += sourceBytes + maskBytes + sizeof(GPUInstanceCell);
+}
+
+void FoliageRenderer::evictTile(int tileIndex){
+    StreamedTile &tile = m_tiles[tileIndex];
+    int slot = tile.slot;
+    InstanceCell &cell = m_cells[slot];
+    m_cullSpheresDirty = true;
+    // trampled instances already left the active set
+    for(GLuint i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; ++i){
+        if(m_instances[i].isActive) removeActiveInstance(i);
+    }
+    GLuint count = cell.instanceCount;
+    cell.instanceCount = 0;
+    computeCellBounds(cell, m_instances);
+    tile.slot = -1;
+    m_slotTiles[slot] = -1;
+    m_cullDirty = true;
+
+    // The source entries stay as they are, cleared mask words and an empty cell hide them
+    if(!m_sourceInstanceSSBO || m_sourceDirty) return;
+    GLuint firstWord = cell.firstInstance >> 5;
+    GLsizeiptr maskBytes = (GLsizeiptr)((count + 31) / 32) * sizeof(GLuint);
+    m_stream.upload(m_activeMaskSSBO, (GLintptr)firstWord * sizeof(GLuint), &m_activeMask[firstWord], maskBytes);
+    uploadCell(slot);
+    m_profileData.streamUploadBytes += maskBytes + sizeof(GPUInstanceCell);
+}
+
+void FoliageRenderer::uploadCell(size_t cellIndex){
+    const InstanceCell &cell = m_cells[cellIndex];
+    GPUInstanceCell gpuCell;
+    gpuCell.boundsMin = glm::vec4(cell.boundsMin, 0.0f);
+    gpuCell.boundsMax = glm::vec4(cell.boundsMax, 0.0f);
+    gpuCell.firstInstance = cell.firstInstance;
+    gpuCell.instanceCount = cell.instanceCount;
+    gpuCell.pad[0] = gpuCell.pad[1] = 0;
+    m_stream.upload(m_cellSSBO, (GLintptr)cellIndex * sizeof(GPUInstanceCell), &gpuCell, sizeof(gpuCell));
+}
+
+void FoliageRenderer::loadPoissonSamplesAsync(const std::string& filename){
+    cancelSampleLoad();
+    m_loadInFlight = true;
+    // Seeded here so the mesh assignment still follows srand()
+    unsigned seed = (unsigned)rand();
+    m_loadThread = std::thread(&FoliageRenderer::loadSamplesWorker, this, filename, seed);
+}
+
+void FoliageRenderer::loadSamplesWorker(std::string filename, unsigned seed){
+    // Only touches m_pendingSet and m_meshes (read-only after initialize) until m_loadReady is set
+    PendingInstanceSet &set = m_pendingSet;
+    // Instances are built straight from the mapped file, no intermediate sample vector
+    MappedSS2File samples;
+    if(!samples.open(filename)){
+        std::cerr << "Failed to load spatial samples from " << filename << std::endl;
+        set.failed = true;
+        m_loadReady = true;
+        return;
+    }
+    std::cout << "Mapped " << samples.size() << " spatial samples from " << filename << std::endl;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> randVal(0.0f, 1.0f);
+    set.instances.reserve(samples.size());
+    for(size_t i = 0; i < samples.size(); ++i){
+        if((i & 4095) == 0 && m_loadCancel) return;
+        set.instances.push_back(makeInstance(samples[i], randVal(rng)));
+    }
+    buildInstanceCells(set.instances, set.cells);
+    set.source.reserve(set.instances.size());
+    for(const InstanceData &inst : set.instances) set.source.push_back(packInstance(inst));
+    printDistribution(set.instances);
+    m_loadReady = true;
+}
+
+void FoliageRenderer::advancePendingSampleSet(){
+    if(!m_loadInFlight || !m_loadReady) return;
+    if(m_loadThread.joinable()) m_loadThread.join();
+    if(m_pendingSet.failed){
+        cancelSampleLoad();
+        return;
+    }
+    // Source buffer filled a slice per frame through the upload ring
+    GLsizeiptr total = (GLsizeiptr)m_pendingSet.source.size() * sizeof(GPUInstancePacked);
+    if(m_gpuCullingEnabled && total > 0){
+        if(m_pendingSourceSSBO == 0){
+            glGenBuffers(1, &m_pendingSourceSSBO);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pendingSourceSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, total, nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            m_pendingUploaded = 0;
+        }
+        GLsizeiptr slice = std::min(SAMPLE_UPLOAD_BYTES_PER_FRAME, total - m_pendingUploaded);
+        m_stream.upload(m_pendingSourceSSBO, m_pendingUploaded, (const char*)m_pendingSet.source.data() + m_pendingUploaded, slice);
+        m_pendingUploaded += slice;
+        if(m_pendingUploaded < total) return; // the previous set keeps rendering
+    }
+    swapInPendingSampleSet();
+}
+
+void FoliageRenderer::swapInPendingSampleSet(){
+    stopStreaming();
+    // Hits still on the GPU belong to the outgoing set
+    flushCollisionReadback();
+    beginInstanceSet(m_pendingSet.instances.size());
+    m_instances.swap(m_pendingSet.instances);
+    m_cells.swap(m_pendingSet.cells);
+    buildCollisionGrid();
+    for(uint32_t newIndex = 0; newIndex < (uint32_t)m_instances.size(); ++newIndex){
+        addActiveInstance(newIndex);
+    }
+    GLsizeiptr total = (GLsizeiptr)m_pendingSet.source.size() * sizeof(GPUInstancePacked);
+    if(m_pendingSourceSSBO && m_pendingUploaded == total){
+        if(m_sourceInstanceSSBO) glDeleteBuffers(1, &m_sourceInstanceSSBO);
+        m_sourceInstanceSSBO = m_pendingSourceSSBO;
+        m_pendingSourceSSBO = 0;
+        m_sourceInstanceCount = (GLuint)m_instances.size();
+        allocateCullBuffers();
+        m_sourceDirty = false;
+    }
+    // otherwise the next GPU cull rebuilds the source buffer in one go
+    cancelSampleLoad();
+}
+
+void FoliageRenderer::cancelSampleLoad(){
+    if(m_loadThread.joinable()){
+        m_loadCancel = true;
+        m_loadThread.join();
+    }
+    m_loadCancel = false;
+    m_loadReady = false;
+    m_loadInFlight = false;
+    m_pendingSet = PendingInstanceSet();
+    if(m_pendingSourceSSBO){
+        glDeleteBuffers(1, &m_pendingSourceSSBO);
+        m_pendingSourceSSBO = 0;
+    }
+    m_pendingUploaded = 0;
+}
@@ -1,10 +1,20 @@
 #pragma once
 
 #include "../include/glad/glad.h"
+#include "stream_buffer.h"
+#include "job_system.h"
+#include "spatial_sample_loader.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 #include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class GPUProfiler;
 
 struct InstanceData {
     glm::mat4 modelMatrix;
@@ -13,7 +23,7 @@ struct InstanceData {
     int meshType; // 0=grass, 1=bush01, 2=bush05
     int textureIndex;
     bool isActive;
-    bool isVisible;
+    int lod; // level of detail picked by CPU culling, valid for visible instances
 };
 
 // Draw command structure for glMultiDrawElementsIndirect
@@ -44,8 +54,24 @@ public:
     ~FoliageRenderer();
 
     bool initialize();
+    // Meshes and bounds only, no GL objects: CPU culling and collisions without a context (foliage_bench)
+    bool initializeCPUOnly();
     void loadPoissonSamples(const std::string& filename);
+    // loadPoissonSamples for samples already in memory
+    void loadSamples(const std::vector<SpatialSamplePoint>& samples);
+    // Loads and builds the set on a worker thread; the current set keeps rendering until cull() swaps it in
+    void loadPoissonSamplesAsync(const std::string& filename);
+    bool isLoadingSamples() const { return m_loadInFlight; }
+    // Streamed world: tiles near the player are loaded on a worker thread into a fixed pool of slots
+    bool loadTiledWorld(const std::string& manifestPath);
+    void updateStreaming(const glm::vec3& playerPos);
+    bool isStreaming() const { return m_streaming; }
+    void setStreamingRadius(float radius) { m_streamingRadius = radius; }
+    float getStreamingRadius() const { return m_streamingRadius; }
     // Rendering functions
+    // cull() runs once per frame with the player camera, draw() reuses its result for every viewport
+    void cull(const glm::mat4& playerView, const glm::mat4& playerProjection, const glm::vec3& playerPos);
+    void draw(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
     void render(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos,
                 const glm::mat4& playerView, const glm::mat4& playerProjection, const glm::vec3& playerPos);
     // Collision detection and interaction
@@ -53,9 +79,45 @@ public:
     // Frustum
     void renderFrustumFrame(const glm::mat4& view, const glm::mat4& projection,
                            const glm::mat4& playerView, const glm::mat4& playerProjection);
+    // CPU frustum culling into per-mesh visible lists and InstanceData::lod, what cull() runs with GPU culling off
+    void performFrustumCulling(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
+    size_t getCPUVisibleCount() const;
+    // Bucketing and packing half of CPU culling into a CPU-side array, no GL (foliage_bench); returns the instance count
+    size_t packVisibleInstances(const glm::vec3& cameraPos);
+    // Threads CPU culling and packing are split across, the calling thread included (0 = one per core)
+    void setCPUThreadCount(unsigned threadCount) { m_jobs.setThreadCount(threadCount); }
+    unsigned getCPUThreadCount() const { return m_jobs.threadCount(); }
+    static std::vector<glm::vec4> extractFrustumPlanes(const glm::mat4& viewProjectionMatrix);
+    const std::vector<InstanceData>& getInstances() const { return m_instances; }
     // Compute shader functions
     void performFrustumCulling(const glm::mat4& viewProjection);
     void updateInstances();
+    // GPU command generation (build_cmd.comp) instead of CPU readback of visible counts
+    void setGPUCommandBuildEnabled(bool enabled) { m_gpuCommandBuildEnabled = enabled; m_cullDirty = true; }
+    bool isGPUCommandBuildEnabled() const { return m_gpuCommandBuildEnabled; }
+    // Two-phase Hi-Z occlusion culling on top of GPU frustum culling
+    void setOcclusionCullingEnabled(bool enabled) { m_occlusionCullingEnabled = enabled; m_cullDirty = true; }
+    bool isOcclusionCullingEnabled() const { return m_occlusionCullingEnabled; }
+    // Distance-based LOD selection (off draws every instance with LOD0)
+    void setLODEnabled(bool enabled) { m_lodEnabled = enabled; m_cullDirty = true; }
+    bool isLODEnabled() const { return m_lodEnabled; }
+    // Trample on the GPU; the CPU copy of isActive catches up through an async readback
+    void setGPUCollisionEnabled(bool enabled) { m_gpuCollisionEnabled = enabled; }
+    bool isGPUCollisionEnabled() const { return m_gpuCollisionEnabled; }
+    // Cull world cells first, then only the instances of surviving cells
+    void setCellCullingEnabled(bool enabled) { m_cellCullingEnabled = enabled; m_cullDirty = true; }
+    bool isCellCullingEnabled() const { return m_cellCullingEnabled; }
+    // 16-byte vertices (unorm16 position, octahedral normal, half UVs) instead of 8 floats
+    void setQuantizedVerticesEnabled(bool enabled) { m_quantizedVerticesEnabled = enabled; }
+    bool isQuantizedVerticesEnabled() const { return m_quantizedVerticesEnabled; }
+    // Coarse front-to-back order inside every (mesh, LOD) bucket so early-Z rejects more fragments
+    void setFrontToBackSortEnabled(bool enabled) { m_frontToBackSortEnabled = enabled; m_cullDirty = true; }
+    bool isFrontToBackSortEnabled() const { return m_frontToBackSortEnabled; }
+    // Source-ordered GPU compaction (count, scan, scatter) instead of one atomic append per instance
+    void setDeterministicCompactionEnabled(bool enabled) { m_deterministicCompactionEnabled = enabled; m_cullDirty = true; }
+    bool isDeterministicCompactionEnabled() const { return m_deterministicCompactionEnabled; }
+    // Wraps the cull, command build, draw and collision passes in GPU timer scopes; null disables
+    void setGPUProfiler(GPUProfiler* profiler) { m_gpuProfiler = profiler; }
 
     struct ProfileData {
         double cpuCullMs = 0.0;
@@ -71,11 +133,42 @@ public:
         double cpuCollisionRebuildMs = 0.0;
         GLuint collisionTests = 0;
         GLuint collisionHits = 0;
+
+        // Occlusion culling counts (read back asynchronously, a few frames old)
+        GLuint occlusionVisible = 0;
+        GLuint occlusionOccluded = 0;
+        GLuint occlusionRecovered = 0; // rejected by phase 1, drawn after phase 2
+
+        // Tile streaming
+        GLuint streamResidentTiles = 0;
+        GLuint streamPendingTiles = 0;
+        GLuint streamPoolInstances = 0; // instances held by occupied slots
+        GLuint streamPoolCapacity = 0;
+        size_t streamUploadBytes = 0; // this frame
+
+        // Player view foliage pass, from queries read back a few frames late
+        GLuint64 fragmentsShaded = 0; // fragment shader invocations
+        GLuint64 samplesPassed = 0;   // samples that passed the depth test
     };
     const ProfileData& getProfileData() const { return m_profileData; }
+    size_t getInstanceCount() const { return m_instances.size(); }
+    // Instances drawn by the current commands; reads the indirect buffer back, so it waits on the GPU
+    GLuint readVisibleInstanceCount() const;
     void resetProfileData() { m_profileData = {}; }
 
 private:
+    static const int MAX_LODS = 3;
+
+    // One level of detail, LOD0 is the mesh as loaded
+    struct MeshLOD {
+        std::vector<GLuint> indices;
+        std::vector<float> vertexData; // empty when the level reuses the LOD0 vertices
+        GLuint indexCount = 0;
+        GLuint firstIndex = 0;    // starting index in combined index buffer
+        GLuint instanceCount = 0; // visible instances drawn with this level
+        GLuint baseInstance = 0;  // starting offset of this (mesh, LOD) bucket in the SSBO
+    };
+
     // Mesh data
     struct MeshData {
         GLuint VAO, VBO, EBO;
@@ -86,6 +179,15 @@ private:
         GLuint instanceCount; // Number of instances for this mesh type
         GLuint baseInstance;  // Starting offset in SSBO for this mesh's packed instances
         GLuint firstIndex; // starting index in combined index buffer
+        // Local-space bounds computed in loadMesh
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        glm::vec3 boundingCenter;
+        float boundingRadius;
+        // Box the quantized positions are stored in, covering LOD0 and the loaded levels
+        glm::vec3 quantizeMin;
+        glm::vec3 quantizeExtent;
+        std::vector<MeshLOD> lods; // LOD0..LODn, finest first
     };
     
     std::vector<MeshData> m_meshes;
@@ -113,7 +215,10 @@ private:
     static const int MAX_TEXTURES = 4;
     int m_textureCount;
 
-    bool loadMesh(const std::string& objPath, MeshData& meshData);
+    bool loadFoliageMeshes(bool upload);
+    bool loadMesh(const std::string& objPath, MeshData& meshData, bool upload);
+    void loadLODChain(const std::string& objPath, MeshData& meshData);
+    bool generateSimplifiedLOD(const MeshData& meshData, const MeshLOD& source, int gridResolution, MeshLOD& lod);
     bool loadTextures();
     GLuint createComputeShader(const std::string& source);
     GLuint createShaderProgram(const std::string& vertexSource, const std::string& fragmentSource);
@@ -124,9 +229,8 @@ private:
     void setupInstanceBuffers(); 
     void setupInstanceBuffers(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
     void performFrustumCulling();
-    void performFrustumCulling(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
-    std::vector<glm::vec4> extractFrustumPlanes(const glm::mat4& viewProjectionMatrix);
     void updateInstanceSSBO();
+    void reserveInstanceSSBO(GLsizeiptr size);
     
     // Frustum visualization functions
     void initializeFrustumVisualization();
@@ -136,6 +240,8 @@ private:
     glm::mat4 m_lastViewProjection;
     glm::mat4 m_lastPlayerView;
     glm::mat4 m_lastPlayerProjection;
+    // cull() is skipped while the player camera and the active set stay unchanged
+    bool m_cullDirty = true;
     
     // Frustum visualization
     GLuint m_frustumVAO, m_frustumVBO;
@@ -143,25 +249,263 @@ private:
     bool m_frustumInitialized;
     ProfileData m_profileData;
 
+    // 16 bytes: instances are translation + Y rotation only, shaders rebuild the matrices
     struct GPUInstancePacked {
-        glm::mat4 model;
-        glm::vec4 info;
+        glm::vec3 position;
+        GLuint packedInfo; // bits 0-15 rotation (2*pi/65536 steps), 16-23 mesh type, 24-31 texture index
     };
+    static GPUInstancePacked packInstance(const InstanceData& inst);
+    static InstanceData makeInstance(const SpatialSamplePoint& sample, float randVal);
     std::vector<GPUInstancePacked> m_gpuInstances;
+    GLsizeiptr m_instanceSSBOSize = 0;
+
+    // Per-frame uploads (commands, counters, frustum lines, instance patches) go through here
+    static const GLsizeiptr STREAM_BYTES_PER_FRAME = 4 * 1024 * 1024;
+    StreamBuffer m_stream;
 
     // buffers for multi-draw indirect
     GLuint m_combinedVAO = 0;
     GLuint m_combinedVBO = 0;
     GLuint m_combinedEBO = 0;
     bool m_combinedBuilt = false;
+    // Same vertices quantized, sharing m_combinedEBO
+    GLuint m_quantizedVAO = 0;
+    GLuint m_quantizedVBO = 0;
+    bool m_quantizedVerticesEnabled = true;
     void buildCombinedBuffers();
+    void bindCombinedVertices(GLuint program);
     void updateIndirectBuffer();
     
     // GPU culling
     bool m_gpuCullingEnabled = true;
     GLuint m_sourceInstanceSSBO = 0; // holds all active instances grouped by mesh
-    std::vector<GLuint> m_meshActiveCounts; // total active per mesh (capacity for grouping)
+    bool m_sourceDirty = true; // instance set replaced, source buffer must be rebuilt before culling
+    std::vector<GLuint> m_meshSourceCounts; // source instances per mesh (capacity for grouping)
+    GLuint m_sourceInstanceCount = 0;
+    // Activity bitmask, bit i of word i/32 is instance i. The source buffer holds every
+    // instance and stays untouched after a load; trampling only clears bits
+    std::vector<GLuint> m_activeMask;
+    std::vector<GLuint> m_dirtyMaskWords; // cleared on the CPU, not yet uploaded
+    GLuint m_activeMaskSSBO = 0;
+    void flushActiveMask();
+
+    // Instances are stored cell by cell; each cell is a contiguous m_instances range
+    static constexpr float INSTANCE_CELL_SIZE = 16.0f;
+    struct InstanceCell {
+        glm::vec3 boundsMin; // AABB of the instances' bounding spheres
+        glm::vec3 boundsMax;
+        GLuint firstInstance;
+        GLuint instanceCount;
+        std::vector<GLuint> meshCounts;
+    };
+    struct GPUInstanceCell {
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        GLuint firstInstance;
+        GLuint instanceCount;
+        GLuint pad[2];
+    };
+    std::vector<InstanceCell> m_cells;
+    bool m_cellCullingEnabled = true;
+    GLuint m_cellCullShader = 0;
+    GLuint m_cellSSBO = 0;
+    GLuint m_visibleCellSSBO = 0; // dispatch args for the instance pass, then surviving cell indices
+    bool usesCellCulling() const { return m_cellCullingEnabled && m_cellCullShader != 0 && !m_cells.empty(); }
+    void beginInstanceSet(size_t instanceCount);
+    void buildInstanceCells(std::vector<InstanceData>& instances, std::vector<InstanceCell>& cells) const;
+    void computeCellBounds(InstanceCell& cell, const std::vector<InstanceData>& instances) const;
+
+    // CPU culling input: world-space bounding spheres of the cell instances as arrays for the
+    // SIMD kernel, ordered by cell then mesh so every (cell, mesh) run is contiguous and in
+    // instance order. Inactive instances get radius -FLT_MAX, which never passes a plane.
+    struct CullSpheres {
+        std::vector<float> x, y, z, radius;
+        std::vector<GLuint> instance; // m_instances index per sphere
+        std::vector<GLuint> runStart;   // first sphere of run cell * meshes + mesh, plus an end entry
+        std::vector<GLuint> runVisible; // per run, its room in m_cpuVisible
+    };
+    CullSpheres m_cullSpheres;
+    std::vector<GLuint> m_cullSphereSlots; // per instance, its sphere (~0u outside every cell)
+    bool m_cullSpheresDirty = true;        // instances or cells changed since the last build
+    // performFrustumCulling output: visible instance indices, mesh by mesh with room for all
+    // spheres. Cells are culled in chunks on m_jobs; a chunk packs its visible instances to the
+    // front of its part of each mesh's range, so chunk after chunk is instance order.
+    std::vector<GLuint> m_cpuVisible;
+    static const GLuint CULL_CHUNK_SPHERES = 8192; // consecutive cells grouped into chunks of about this size
+    struct CullChunk {
+        GLuint firstCell;
+        GLuint cellEnd;
+        std::vector<GLuint> visibleCounts; // per mesh
+        std::vector<GLuint> bucketCounts;  // per (mesh, LOD)
+        std::vector<GLuint> bucketCursor;  // where packing writes the chunk's next instance of each bucket
+    };
+    std::vector<CullChunk> m_cullChunks;
+    JobSystem m_jobs;
+    void rebuildCullSpheres();
+    void setCullSphereActive(uint32_t instIdx, bool active);
+    void cullChunk(CullChunk& chunk, const std::vector<glm::vec4>& frustumPlanes, const glm::vec3& cameraPos, float lodScale);
+    // Prefix sums over buckets, then over chunks within a bucket; returns the instance count
+    GLuint layoutCPUBuckets();
+    void packCPUBuckets(GPUInstancePacked* dst, const glm::vec3& cameraPos);
+    static void printDistribution(const std::vector<InstanceData>& instances);
+    void updateBucketCapacities();
+    void dispatchCellCulling(const std::vector<glm::vec4>& frustumPlanes, const glm::vec3& cameraPos);
     void rebuildSourceInstanceBuffer();
+    void allocateCullBuffers(); // everything sized by the source set, except the source buffer itself
     void dispatchComputeCulling(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
     void rebuildActiveInstanceIndices();
+
+    // GPU command generation
+    bool m_gpuCommandBuildEnabled = true;
+    GLuint m_meshInfoSSBO = 0; // per (mesh, LOD) bucket: indexCount, firstIndex, baseVertex
+    GLsizeiptr m_indirectBufferSize = 0;
+    bool usesGPUCommandBuild() const { return m_gpuCullingEnabled && m_gpuCommandBuildEnabled && m_instanceUpdateShader != 0; }
+    // LOD selection: a level is used while the projected sphere radius (fraction of half the
+    // screen height) stays above its threshold, the last level takes everything smaller
+    bool m_lodEnabled = true;
+    float m_lodScreenSizes[MAX_LODS - 1] = {0.10f, 0.04f};
+    GLuint commandCount() const { return (GLuint)m_meshes.size() * MAX_LODS; } // one per (mesh, LOD) bucket
+    int selectLOD(const MeshData& mesh, const glm::vec3& center, const glm::vec3& cameraPos, float lodScale) const;
+    void buildIndirectCommandsGPU(const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities);
+    static constexpr float CULL_DISTANCE = 100.0f;
+
+    // Front-to-back sort: counting sort on distance bins (foliage_sort.comp), std::sort on the CPU path
+    static const GLuint SORT_BINS = 256;
+    bool m_frontToBackSortEnabled = false;
+    GLuint m_sortShader = 0;
+    GLuint m_sortScratchSSBO = 0; // mirrors m_instanceSSBO
+    GLsizeiptr m_sortScratchSize = 0;
+    GLuint m_sortBinsSSBO = 0;    // SORT_BINS counters per bucket
+    void dispatchFrontToBackSort(const glm::vec3& cameraPos, const std::vector<GLuint>& baseOffsets,
+                                 const std::vector<GLuint>& capacities, GLuint totalCapacity);
+    // Deterministic compaction: the cull pass stores a bucket per source instance,
+    // foliage_compact.comp counts per cull workgroup, scans and scatters
+    bool m_deterministicCompactionEnabled = false;
+    GLuint m_compactShader = 0;
+    GLuint m_decisionSSBO = 0;   // one bucket (or ~0u) per source instance
+    GLuint m_groupCountSSBO = 0; // per workgroup (or cell) and bucket: count, then offset
+    GLsizeiptr m_groupCountSize = 0;
+    bool usesDeterministicCompaction() const { return m_deterministicCompactionEnabled && m_compactShader != 0; }
+    void compactVisibleInstances(const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities);
+    GPUProfiler* m_gpuProfiler = nullptr; // not owned
+    // Fragment shader invocation and samples-passed queries around the player view draw
+    static const int OVERDRAW_QUERY_FRAMES = 4;
+    GLuint m_overdrawQueries[OVERDRAW_QUERY_FRAMES][2] = {};
+    bool m_overdrawQueryPending[OVERDRAW_QUERY_FRAMES] = {};
+    int m_overdrawQueryNext = 0;
+    void readOverdrawQueries();
+
+    // Hi-Z occlusion culling
+    static const int HIZ_SIZE = 512;
+    bool m_occlusionCullingEnabled = false;
+    bool m_hizValid = false; // pyramid holds depth from an earlier cull
+    int m_hizLevels = 0;
+    GLuint m_hizBuildShader = 0;
+    GLuint m_occlusionFBO = 0;
+    GLuint m_occlusionDepthTex = 0;
+    GLuint m_hizTexture = 0;
+    GLuint m_occlusionStatsSSBO = 0; // phase 2 dispatch args + counters
+    GLuint m_occludedListSSBO = 0;
+    GLsizeiptr m_occludedListSize = 0;
+    GLuint m_occlusionStatsReadback = 0;
+    GLsync m_occlusionStatsFence = 0;
+    bool usesOcclusionCulling() const { return usesGPUCommandBuild() && m_occlusionCullingEnabled && m_hizBuildShader != 0; }
+    void initializeOcclusionCulling();
+    void runOcclusionPhase2(const glm::mat4& view, const glm::mat4& projection,
+                            const std::vector<GLuint>& baseOffsets, const std::vector<GLuint>& capacities);
+    void renderOcclusionDepth(const glm::mat4& view, const glm::mat4& projection);
+    void buildHiZPyramid();
+    void readOcclusionStats();
+
+    // Collision broadphase: uniform XZ grid of active instance indices
+    static constexpr float COLLISION_CELL_SIZE = 2.0f;
+    static constexpr float GRASS_COLLISION_RADIUS = 0.45f;
+    static constexpr float BUSH_COLLISION_RADIUS = 0.75f; // bush01 and bush05
+    static constexpr float MAX_FOLIAGE_COLLISION_RADIUS =
+        GRASS_COLLISION_RADIUS > BUSH_COLLISION_RADIUS ? GRASS_COLLISION_RADIUS : BUSH_COLLISION_RADIUS;
+    static const int MAX_COLLISION_GRID_EXTENT = 1024; // cells per axis, larger worlds get coarser cells
+    float m_collisionCellSize = COLLISION_CELL_SIZE;
+    glm::vec2 m_collisionGridOrigin = glm::vec2(0.0f);
+    int m_collisionGridWidth = 0;
+    int m_collisionGridDepth = 0;
+    std::vector<std::vector<GLuint>> m_collisionCells;
+    std::vector<int> m_collisionCellSlots; // per instance, position inside its cell (-1 once removed)
+    static float foliageCollisionRadius(int meshType) { return (meshType == 1 || meshType == 2) ? BUSH_COLLISION_RADIUS : GRASS_COLLISION_RADIUS; }
+    int collisionCellCoord(float v, float origin, int extent) const;
+    void buildCollisionGrid();
+    void buildCollisionGrid(const glm::vec2& minXZ, const glm::vec2& maxXZ);
+    void addActiveInstance(uint32_t instIdx);
+    void removeActiveInstance(uint32_t instIdx);
+
+    // GPU collision deactivation
+    static const int MAX_COLLIDERS = 8;
+    static const GLuint COLLISION_READBACK_WINDOW = 4096; // hit indices fetched per readback
+    bool m_gpuCollisionEnabled = true;
+    GLuint m_collisionShader = 0;
+    GLuint m_collisionHitsSSBO = 0;  // hitCount + source indices deactivated since the last rebuild
+    GLuint m_collisionHitsReadback = 0;
+    GLsync m_collisionHitsFence = 0;
+    GLuint m_collisionHitsApplied = 0;      // hits already mirrored into m_instances
+    bool m_collisionReadbackRequested = false;
+    std::vector<glm::vec4> m_lastColliders;
+    bool usesGPUCollisions() const { return m_gpuCullingEnabled && m_gpuCollisionEnabled && m_collisionShader != 0 && m_sourceInstanceSSBO != 0 && !m_sourceDirty; }
+    void dispatchCollisionPass(const std::vector<glm::vec4>& colliders);
+    GLuint pollCollisionReadback(bool wait);
+    void flushCollisionReadback();
+    void resetCollisionHits();
+
+    // Tile streaming. m_instances is a pool of TILE_POOL_SLOTS slots of m_tileSlotCapacity
+    // instances; slot s is m_cells[s], so cell culling skips empty slots for free
+    static const int TILE_POOL_SLOTS = 32;
+    static const int MAX_TILE_INSTALLS_PER_FRAME = 4;
+    static constexpr float TILE_EVICT_MARGIN = 1.25f; // evict beyond radius * margin, avoids thrashing at the edge
+    struct StreamedTile {
+        SpatialSampleTile info;
+        int slot = -1;        // pool slot while resident
+        bool pending = false; // queued on or loaded by the worker, not yet installed
+    };
+    struct LoadedTile {
+        int tileIndex;
+        std::vector<InstanceData> instances;
+    };
+    bool m_streaming = false;
+    float m_streamingRadius = 200.0f;
+    float m_tileSize = 0.0f;
+    GLuint m_tileSlotCapacity = 0; // multiple of 32, so each slot owns whole mask words
+    std::vector<StreamedTile> m_tiles;
+    std::vector<int> m_slotTiles; // tile held by each slot, -1 when free
+    std::vector<LoadedTile> m_readyTiles; // loaded, waiting for a slot or an install budget
+    // Worker thread state, guarded by m_streamMutex
+    std::thread m_streamThread;
+    std::mutex m_streamMutex;
+    std::condition_variable m_streamCondition;
+    std::deque<int> m_streamRequests;
+    std::vector<LoadedTile> m_streamResults;
+    bool m_streamStop = false;
+    void stopStreaming();
+    void streamWorker();
+    float tileDistance(const StreamedTile& tile, const glm::vec3& playerPos) const;
+    void installTile(LoadedTile& tile, int slot);
+    void evictTile(int tileIndex);
+    void uploadCell(size_t cellIndex);
+
+    // Asynchronous sample-set loads: built on m_loadThread, uploaded by cull() in slices, then swapped in
+    static const GLsizeiptr SAMPLE_UPLOAD_BYTES_PER_FRAME = 1024 * 1024;
+    struct PendingInstanceSet {
+        std::vector<InstanceData> instances; // already sorted into cells
+        std::vector<InstanceCell> cells;
+        std::vector<GPUInstancePacked> source;
+        bool failed = false;
+    };
+    std::thread m_loadThread;
+    std::atomic<bool> m_loadReady{false};  // worker finished m_pendingSet
+    std::atomic<bool> m_loadCancel{false};
+    bool m_loadInFlight = false;
+    PendingInstanceSet m_pendingSet;
+    GLuint m_pendingSourceSSBO = 0;
+    GLsizeiptr m_pendingUploaded = 0;
+    void loadSamplesWorker(std::string filename, unsigned seed);
+    void advancePendingSampleSet();
+    void swapInPendingSampleSet();
+    void cancelSampleLoad();
 };
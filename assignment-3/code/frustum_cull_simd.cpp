@@ -0,0 +1,211 @@
+#include "frustum_cull_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FRUSTUM_CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FRUSTUM_CULL_TARGET(isa)
+#else
+#define FRUSTUM_CULL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace FrustumCull {
+
+namespace {
+
+const int PLANE_COUNT = 6;
+
+size_t cullScalar(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                  const glm::vec4* planes, uint32_t firstIndex, uint32_t* visibleOut) {
+    size_t visible = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool inside = true;
+        for (int p = 0; p < PLANE_COUNT; ++p) {
+            float distance = planes[p].x * x[i] + planes[p].y * y[i] + planes[p].z * z[i] + planes[p].w;
+            if (distance < -radius[i]) { // sphere entirely outside
+                inside = false;
+                break;
+            }
+        }
+        // Always written, only kept when visible
+        visibleOut[visible] = firstIndex + (uint32_t)i;
+        visible += inside ? 1 : 0;
+    }
+    return visible;
+}
+
+#ifdef FRUSTUM_CULL_X86
+
+// Left-packing tables indexed by the visible-lane bitmask
+struct CompressTables {
+    uint32_t permute8[256][8];  // AVX2 lane indices for _mm256_permutevar8x32_epi32
+    uint8_t shuffle4[16][16];   // SSE byte indices for _mm_shuffle_epi8
+    uint8_t popcount[256];
+
+    CompressTables() {
+        for (int mask = 0; mask < 256; ++mask) {
+            int n = 0;
+            for (int lane = 0; lane < 8; ++lane) {
+                if (mask & (1 << lane)) permute8[mask][n++] = (uint32_t)lane;
+            }
+            popcount[mask] = (uint8_t)n;
+            for (int lane = n; lane < 8; ++lane) permute8[mask][lane] = 0;
+        }
+        for (int mask = 0; mask < 16; ++mask) {
+            int n = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                if (!(mask & (1 << lane))) continue;
+                for (int b = 0; b < 4; ++b) shuffle4[mask][n * 4 + b] = (uint8_t)(lane * 4 + b);
+                n++;
+            }
+            for (int b = n * 4; b < 16; ++b) shuffle4[mask][b] = 0x80; // zero fill
+        }
+    }
+};
+
+const CompressTables g_tables;
+
+// distance = ((px * x + py * y) + pz * z) + pw, the scalar kernel's order, so results match bit for bit
+FRUSTUM_CULL_TARGET("avx2")
+size_t cullAVX2(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                const glm::vec4* planes, uint32_t firstIndex, uint32_t* visibleOut) {
+    __m256 px[PLANE_COUNT], py[PLANE_COUNT], pz[PLANE_COUNT], pw[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        px[p] = _mm256_set1_ps(planes[p].x);
+        py[p] = _mm256_set1_ps(planes[p].y);
+        pz[p] = _mm256_set1_ps(planes[p].z);
+        pw[p] = _mm256_set1_ps(planes[p].w);
+    }
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t visible = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 cx = _mm256_loadu_ps(x + i);
+        __m256 cy = _mm256_loadu_ps(y + i);
+        __m256 cz = _mm256_loadu_ps(z + i);
+        __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(radius + i), signBit);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < PLANE_COUNT; ++p) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy)),
+                                                          _mm256_mul_ps(pz[p], cz)), pw[p]);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+            // Instances come cell by cell, so whole blocks usually leave through the same plane
+            if (_mm256_movemask_ps(outside) == 0xFF) break;
+        }
+        int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+        if (!mask) continue;
+        // Visible indices packed to the front; the full-width store never reaches past index i + 7
+        __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int)(firstIndex + (uint32_t)i)), laneIndex);
+        __m256i permute = _mm256_loadu_si256((const __m256i*)g_tables.permute8[mask]);
+        _mm256_storeu_si256((__m256i*)(visibleOut + visible), _mm256_permutevar8x32_epi32(indices, permute));
+        visible += g_tables.popcount[mask];
+    }
+    // The scalar tail is SSE code; dirty upper halves would slow down every instruction in it
+    _mm256_zeroupper();
+    return visible + cullScalar(x + i, y + i, z + i, radius + i, count - i, planes, firstIndex + (uint32_t)i, visibleOut + visible);
+}
+
+FRUSTUM_CULL_TARGET("sse4.1")
+size_t cullSSE41(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                 const glm::vec4* planes, uint32_t firstIndex, uint32_t* visibleOut) {
+    __m128 px[PLANE_COUNT], py[PLANE_COUNT], pz[PLANE_COUNT], pw[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        px[p] = _mm_set1_ps(planes[p].x);
+        py[p] = _mm_set1_ps(planes[p].y);
+        pz[p] = _mm_set1_ps(planes[p].z);
+        pw[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    size_t visible = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(radius + i), signBit);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < PLANE_COUNT; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+                                                    _mm_mul_ps(pz[p], cz)), pw[p]);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+            if (_mm_movemask_ps(outside) == 0xF) break;
+        }
+        int mask = ~_mm_movemask_ps(outside) & 0xF;
+        if (!mask) continue;
+        __m128i indices = _mm_add_epi32(_mm_set1_epi32((int)(firstIndex + (uint32_t)i)), laneIndex);
+        __m128i shuffle = _mm_loadu_si128((const __m128i*)g_tables.shuffle4[mask]);
+        _mm_storeu_si128((__m128i*)(visibleOut + visible), _mm_shuffle_epi8(indices, shuffle));
+        visible += g_tables.popcount[mask];
+    }
+    return visible + cullScalar(x + i, y + i, z + i, radius + i, count - i, planes, firstIndex + (uint32_t)i, visibleOut + visible);
+}
+
+Kernel detectKernel() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX state has to be enabled by the OS (OSXSAVE and XCR0 bits 1-2)
+    bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (osAVX && maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+#endif
+    if (avx2) return KERNEL_AVX2;
+    if (sse41) return KERNEL_SSE41;
+    return KERNEL_SCALAR;
+}
+
+#else
+
+Kernel detectKernel() { return KERNEL_SCALAR; }
+
+#endif
+
+Kernel g_activeKernel = bestKernel();
+
+} // namespace
+
+Kernel bestKernel() {
+    static const Kernel best = detectKernel();
+    return best;
+}
+
+Kernel activeKernel() {
+    return g_activeKernel;
+}
+
+void setKernel(Kernel kernel) {
+    g_activeKernel = kernel <= bestKernel() ? kernel : bestKernel();
+}
+
+const char* kernelName(Kernel kernel) {
+    switch (kernel) {
+    case KERNEL_AVX2: return "AVX2";
+    case KERNEL_SSE41: return "SSE4.1";
+    default: return "scalar";
+    }
+}
+
+size_t cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                   const glm::vec4* planes, uint32_t firstIndex, uint32_t* visibleOut) {
+#ifdef FRUSTUM_CULL_X86
+    if (g_activeKernel == KERNEL_AVX2) return cullAVX2(x, y, z, radius, count, planes, firstIndex, visibleOut);
+    if (g_activeKernel == KERNEL_SSE41) return cullSSE41(x, y, z, radius, count, planes, firstIndex, visibleOut);
+#endif
+    return cullScalar(x, y, z, radius, count, planes, firstIndex, visibleOut);
+}
+
+} // namespace FrustumCull
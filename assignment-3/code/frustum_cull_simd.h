@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Sphere-vs-frustum tests over structure-of-arrays input, 8 (AVX2) or 4 (SSE4.1) spheres
+// against all six planes per step. The widest kernel the CPU supports is picked at startup;
+// the scalar one is the fallback and the reference, every kernel gives the same result.
+namespace FrustumCull {
+
+enum Kernel {
+    KERNEL_SCALAR = 0,
+    KERNEL_SSE41,
+    KERNEL_AVX2
+};
+
+Kernel bestKernel();
+Kernel activeKernel();
+// Falls back to the best supported kernel when the CPU lacks the requested one
+void setKernel(Kernel kernel);
+const char* kernelName(Kernel kernel);
+
+// Sphere i is visible unless plane.xyz . (x[i], y[i], z[i]) + plane.w < -radius[i] for one
+// of the planes, so a negative radius like -FLT_MAX is never visible. Writes firstIndex + i
+// of every visible sphere to visibleOut in order and returns how many; visibleOut needs
+// room for count entries.
+size_t cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                   const glm::vec4* planes, uint32_t firstIndex, uint32_t* visibleOut);
+
+} // namespace FrustumCull
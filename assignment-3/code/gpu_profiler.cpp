@@ -0,0 +1,103 @@
+#include "gpu_profiler.h"
+#include <iostream>
+#include <cstring>
+
+GPUProfiler::GPUProfiler() : m_frame(0), m_recording(false) {
+}
+
+GPUProfiler::~GPUProfiler() {
+    for(int i = 0; i < FRAME_COUNT; ++i) {
+        if(!m_frames[i].queries.empty()) glDeleteQueries((GLsizei)m_frames[i].queries.size(), m_frames[i].queries.data());
+    }
+}
+
+bool GPUProfiler::initialize() {
+    GLint timestampBits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timestampBits);
+    if(timestampBits == 0) {
+        std::cerr << "GL_TIMESTAMP queries unsupported, GPU timings disabled" << std::endl;
+        return false;
+    }
+    for(int i = 0; i < FRAME_COUNT; ++i) {
+        m_frames[i].queries.resize(MAX_SCOPES_PER_FRAME * 2);
+        glGenQueries((GLsizei)m_frames[i].queries.size(), m_frames[i].queries.data());
+        m_frames[i].records.reserve(MAX_SCOPES_PER_FRAME);
+    }
+    return true;
+}
+
+void GPUProfiler::beginFrame() {
+    if(m_frames[0].queries.empty()) return;
+    if(m_recording) m_frames[m_frame].pending = !m_frames[m_frame].records.empty();
+    // Oldest first; a frame is done once its last timestamp has landed
+    for(int i = 1; i <= FRAME_COUNT; ++i) {
+        Frame& frame = m_frames[(m_frame + i) % FRAME_COUNT];
+        if(!frame.pending) continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.queries[frame.lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) break;
+        collect(frame);
+    }
+    m_frame = (m_frame + 1) % FRAME_COUNT;
+    m_recording = !m_frames[m_frame].pending;
+    if(m_recording) m_frames[m_frame].records.clear();
+    m_open.clear();
+}
+
+void GPUProfiler::begin(const char* name) {
+    Frame& frame = m_frames[m_frame];
+    if(!m_recording || frame.records.size() >= (size_t)MAX_SCOPES_PER_FRAME) {
+        m_open.push_back(-1);
+        return;
+    }
+    int scope = scopeIndex(name);
+    if(m_results[scope].depth < 0) m_results[scope].depth = (int)m_open.size();
+    Record record;
+    record.scope = scope;
+    record.beginQuery = (int)frame.records.size() * 2;
+    glQueryCounter(frame.queries[record.beginQuery], GL_TIMESTAMP);
+    frame.lastQuery = record.beginQuery;
+    m_open.push_back((int)frame.records.size());
+    frame.records.push_back(record);
+}
+
+void GPUProfiler::end() {
+    if(m_open.empty()) return;
+    int record = m_open.back();
+    m_open.pop_back();
+    if(record < 0) return;
+    Frame& frame = m_frames[m_frame];
+    frame.lastQuery = frame.records[record].beginQuery + 1;
+    glQueryCounter(frame.queries[frame.lastQuery], GL_TIMESTAMP);
+}
+
+double GPUProfiler::scopeMs(const char* name) const {
+    for(const ScopeResult& result : m_results) {
+        if(std::strcmp(result.name, name) == 0) return result.ms;
+    }
+    return 0.0;
+}
+
+int GPUProfiler::scopeIndex(const char* name) {
+    for(size_t i = 0; i < m_results.size(); ++i) {
+        if(std::strcmp(m_results[i].name, name) == 0) return (int)i;
+    }
+    ScopeResult result;
+    result.name = name;
+    result.depth = -1;
+    result.ms = 0.0;
+    m_results.push_back(result);
+    return (int)m_results.size() - 1;
+}
+
+void GPUProfiler::collect(Frame& frame) {
+    // Scopes missing from this frame read as zero rather than keeping an old value
+    for(ScopeResult& result : m_results) result.ms = 0.0;
+    for(const Record& record : frame.records) {
+        GLuint64 beginTime = 0, endTime = 0;
+        glGetQueryObjectui64v(frame.queries[record.beginQuery], GL_QUERY_RESULT, &beginTime);
+        glGetQueryObjectui64v(frame.queries[record.beginQuery + 1], GL_QUERY_RESULT, &endTime);
+        if(endTime > beginTime) m_results[record.scope].ms += (double)(endTime - beginTime) / 1.0e6;
+    }
+    frame.pending = false;
+}
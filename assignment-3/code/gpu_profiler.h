@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../include/glad/glad.h"
+#include <vector>
+
+// GPU pass timings from GL_TIMESTAMP query pairs, so scopes may nest. Each frame records
+// into its own set of queries in a ring and is read on the first frame its results are
+// available, at most FRAME_COUNT frames later. When the ring wraps onto a slot that is
+// still in flight, that frame records nothing instead of waiting.
+class GPUProfiler {
+public:
+    static const int FRAME_COUNT = 4;
+    static const int MAX_SCOPES_PER_FRAME = 32;
+
+    struct ScopeResult {
+        const char* name; // string literal passed to begin()
+        int depth;        // nesting level when first seen
+        double ms;        // summed over every begin/end pair of the last collected frame
+    };
+
+    GPUProfiler();
+    ~GPUProfiler();
+
+    bool initialize();
+    // Collects finished frames, then starts recording the next one
+    void beginFrame();
+    // Every begin() needs its end() before the next beginFrame()
+    void begin(const char* name);
+    void end();
+
+    const std::vector<ScopeResult>& results() const { return m_results; }
+    // ms of the named scope in the last collected frame, 0 when it was not recorded
+    double scopeMs(const char* name) const;
+
+private:
+    struct Record { int scope; int beginQuery; };
+    struct Frame {
+        std::vector<GLuint> queries; // begin and end timestamp per record
+        std::vector<Record> records;
+        int lastQuery = 0;    // issued last, so available last
+        bool pending = false;
+    };
+
+    int scopeIndex(const char* name);
+    void collect(Frame& frame);
+
+    Frame m_frames[FRAME_COUNT];
+    int m_frame;
+    bool m_recording;
+    std::vector<int> m_open; // record index per open scope, -1 when it was not recorded
+    std::vector<ScopeResult> m_results;
+};
+
+// Times the enclosing block; a null profiler records nothing
+class GPUProfileScope {
+public:
+    GPUProfileScope(GPUProfiler* profiler, const char* name) : m_profiler(profiler) { if(m_profiler) m_profiler->begin(name); }
+    ~GPUProfileScope() { if(m_profiler) m_profiler->end(); }
+    GPUProfileScope(const GPUProfileScope&) = delete;
+    GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+private:
+    GPUProfiler* m_profiler;
+};
@@ -0,0 +1,116 @@
+#include "job_system.h"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned threadCount)
+    : m_fn(nullptr), m_queued(0), m_unfinished(0), m_stop(false) {
+    setThreadCount(threadCount);
+}
+
+JobSystem::~JobSystem() {
+    stopWorkers();
+}
+
+void JobSystem::setThreadCount(unsigned threadCount) {
+    stopWorkers();
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    m_queues.clear();
+    for (unsigned i = 0; i < threadCount; ++i) m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+}
+
+void JobSystem::startWorkers() {
+    m_stop = false;
+    for (unsigned i = 1; i < threadCount(); ++i) m_workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+void JobSystem::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) worker.join();
+    m_workers.clear();
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkSize, const RangeFn& fn) {
+    if (count == 0) return;
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    size_t jobCount = (count + chunkSize - 1) / chunkSize;
+    if (threadCount() == 1 || jobCount == 1) {
+        for (size_t begin = 0; begin < count; begin += chunkSize) fn(begin, std::min(begin + chunkSize, count), 0);
+        return;
+    }
+    if (m_workers.empty()) startWorkers();
+
+    m_fn = &fn;
+    m_unfinished = jobCount;
+    m_queued = jobCount;
+    // Neighbouring chunks go to the same thread, which works through them back to front;
+    // thieves take from the other end
+    size_t threads = m_queues.size();
+    for (size_t t = 0; t < threads; ++t) {
+        Queue& queue = *m_queues[t];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t j = jobCount * t / threads; j < jobCount * (t + 1) / threads; ++j) {
+            Job job = { j * chunkSize, std::min((j + 1) * chunkSize, count) };
+            queue.jobs.push_back(job);
+        }
+    }
+    {
+        // Workers test m_queued under m_mutex, so the notify cannot fall between test and wait
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_wake.notify_all();
+
+    Job job;
+    while (popOrSteal(0, job)) runJob(job, 0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_unfinished.load() == 0; });
+    m_fn = nullptr;
+}
+
+void JobSystem::workerLoop(unsigned thread) {
+    for (;;) {
+        Job job;
+        if (popOrSteal(thread, job)) {
+            runJob(job, thread);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+        if (m_stop) return;
+    }
+}
+
+bool JobSystem::popOrSteal(unsigned thread, Job& job) {
+    {
+        Queue& own = *m_queues[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            m_queued--;
+            return true;
+        }
+    }
+    // Steal the oldest job of the next thread that has one
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        Queue& victim = *m_queues[(thread + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            m_queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::runJob(const Job& job, unsigned thread) {
+    (*m_fn)(job.begin, job.end, thread);
+    if (m_unfinished.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done.notify_all();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for data-parallel loops, one thread per core. Every thread owns a deque of
+// jobs: it pops its own from the back and steals from the front of the others' once it runs
+// dry. The calling thread joins in as thread 0, so a pool of one thread runs everything inline.
+// Worker threads are only started by the first parallelFor that has more than one chunk.
+class JobSystem {
+public:
+    // fn(begin, end, thread); thread < threadCount() indexes per-thread scratch
+    typedef std::function<void(size_t, size_t, unsigned)> RangeFn;
+
+    // 0 threads means one per hardware thread
+    explicit JobSystem(unsigned threadCount = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    void setThreadCount(unsigned threadCount);
+    unsigned threadCount() const { return (unsigned)m_queues.size(); }
+
+    // Runs fn over [0, count) in chunks of at most chunkSize and returns once all of them
+    // have finished. Called from one thread at a time, never from inside fn.
+    void parallelFor(size_t count, size_t chunkSize, const RangeFn& fn);
+
+private:
+    struct Job {
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop(unsigned thread);
+    bool popOrSteal(unsigned thread, Job& job);
+    void runJob(const Job& job, unsigned thread);
+
+    std::vector<std::unique_ptr<Queue>> m_queues; // one per thread, the caller's first
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake; // workers: jobs were queued or the pool stops
+    std::condition_variable m_done; // caller: the last job finished
+    const RangeFn* m_fn;
+    std::atomic<size_t> m_queued;     // pushed, not yet taken by a thread
+    std::atomic<size_t> m_unfinished; // pushed, not yet finished
+    bool m_stop;
+};
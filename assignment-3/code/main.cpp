@@ -12,8 +12,14 @@
 #include "foliage_renderer.h"
 #include "slime_character.h"
 #include "procedural_grid.h"
+#include "gpu_profiler.h"
+#include "benchmark.h"
 #include <iostream>
+#include <fstream>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 enum class CameraMode {
     God = 0,
@@ -35,6 +41,7 @@ void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void loadSampleSet(int index);
 
 
 // default configuration for screen size
@@ -71,6 +78,7 @@ float globalTime = 0.0f;
 FoliageRenderer foliageRenderer;
 SlimeCharacter slimeCharacter;
 ProceduralGrid proceduralGrid;
+GPUProfiler gpuProfiler;
 
 int currentSampleSet = 0;
 const std::vector<std::string> sampleFiles = {
@@ -78,13 +86,32 @@ const std::vector<std::string> sampleFiles = {
     "assets/models/spatialSamples/poissonPoints_2797s.ss2",
     "assets/models/spatialSamples/poissonPoints_155304s.ss2"
 };
+// Sample set after the files above: a streamed world generated on first use
+const std::string tiledWorldManifest = "assets/models/spatialSamples/world_tiles.tiles";
+const int tiledWorldRepeat = 4;       // copies of the largest set per axis
+const float tiledWorldTileSize = 125.0f;
 
 float frameCount = 0;
 float fps = 0;
 float fpsTimer = 0;
 
-int main()
+int main(int argc, char** argv)
 {
+    // project --benchmark [--frames N] [--warmup N] [--dt seconds] [--out prefix]
+    bool benchmark = false;
+    BenchmarkSettings benchmarkSettings;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--benchmark") == 0) benchmark = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) benchmarkSettings.frames = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue) benchmarkSettings.warmupFrames = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--dt") == 0 && hasValue) benchmarkSettings.deltaTime = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--out") == 0 && hasValue) benchmarkSettings.outputPrefix = argv[++i];
+        else std::cerr << "Ignoring unknown argument " << argv[i] << std::endl;
+    }
+    if (benchmark)
+        return runBenchmark(benchmarkSettings, sampleFiles);
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
@@ -141,12 +168,18 @@ int main()
         return -1;
     }
 
-    foliageRenderer.loadPoissonSamples(sampleFiles[currentSampleSet]);
+    if (gpuProfiler.initialize()) {
+        foliageRenderer.setGPUProfiler(&gpuProfiler);
+    }
+
+    loadSampleSet(currentSampleSet);
 
     auto frameStartCPU = std::chrono::high_resolution_clock::now();
     double lastFrameTotalMs = 0.0;
     while (!glfwWindowShouldClose(window))
     {
+        gpuProfiler.beginFrame();
+        gpuProfiler.begin("Frame");
         float currentFrame = glfwGetTime();
         globalTime = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -164,6 +197,7 @@ int main()
         
         slimeCharacter.update(deltaTime);
         
+        foliageRenderer.updateStreaming(playerCamera.Position);
         foliageRenderer.checkCollisions(slimeCharacter.getPosition(), 1.0f);
                 
         ImGui_ImplOpenGL3_NewFrame();
@@ -182,14 +216,57 @@ int main()
         }
         
         ImGui::SeparatorText("Spatial Samples");
-        const char* sampleNames[] = {"1,010 samples", "2,797 samples", "155,304 samples"};
+        const char* sampleNames[] = {"1,010 samples", "2,797 samples", "155,304 samples", "Tiled world (streamed)"};
         int prevSample = currentSampleSet;
         if (ImGui::Combo("Sample Set", &currentSampleSet, sampleNames, IM_ARRAYSIZE(sampleNames))) {
             if (currentSampleSet != prevSample) {
-                foliageRenderer.loadPoissonSamples(sampleFiles[currentSampleSet]);
+                loadSampleSet(currentSampleSet);
+            }
+        }
+        if (foliageRenderer.isLoadingSamples()) {
+            ImGui::Text("Loading sample set...");
+        }
+        if (foliageRenderer.isStreaming()) {
+            float streamingRadius = foliageRenderer.getStreamingRadius();
+            if (ImGui::SliderFloat("Streaming Radius", &streamingRadius, 50.0f, 400.0f)) {
+                foliageRenderer.setStreamingRadius(streamingRadius);
             }
         }
 
+        ImGui::SeparatorText("Foliage Pipeline");
+        bool gpuCommandBuild = foliageRenderer.isGPUCommandBuildEnabled();
+        if (ImGui::Checkbox("GPU Command Build (no readback)", &gpuCommandBuild)) {
+            foliageRenderer.setGPUCommandBuildEnabled(gpuCommandBuild);
+        }
+        bool occlusionCulling = foliageRenderer.isOcclusionCullingEnabled();
+        if (ImGui::Checkbox("Hi-Z Occlusion Culling", &occlusionCulling)) {
+            foliageRenderer.setOcclusionCullingEnabled(occlusionCulling);
+        }
+        bool lodSelection = foliageRenderer.isLODEnabled();
+        if (ImGui::Checkbox("LOD Selection", &lodSelection)) {
+            foliageRenderer.setLODEnabled(lodSelection);
+        }
+        bool gpuCollision = foliageRenderer.isGPUCollisionEnabled();
+        if (ImGui::Checkbox("GPU Collision Deactivation", &gpuCollision)) {
+            foliageRenderer.setGPUCollisionEnabled(gpuCollision);
+        }
+        bool cellCulling = foliageRenderer.isCellCullingEnabled();
+        if (ImGui::Checkbox("Cell Culling (two-level)", &cellCulling)) {
+            foliageRenderer.setCellCullingEnabled(cellCulling);
+        }
+        bool deterministicCompaction = foliageRenderer.isDeterministicCompactionEnabled();
+        if (ImGui::Checkbox("Deterministic Compaction", &deterministicCompaction)) {
+            foliageRenderer.setDeterministicCompactionEnabled(deterministicCompaction);
+        }
+        bool frontToBackSort = foliageRenderer.isFrontToBackSortEnabled();
+        if (ImGui::Checkbox("Front-to-Back Sort", &frontToBackSort)) {
+            foliageRenderer.setFrontToBackSortEnabled(frontToBackSort);
+        }
+        bool quantizedVertices = foliageRenderer.isQuantizedVerticesEnabled();
+        if (ImGui::Checkbox("Quantized Vertices (16 bytes)", &quantizedVertices)) {
+            foliageRenderer.setQuantizedVerticesEnabled(quantizedVertices);
+        }
+
         ImGui::SeparatorText("Player Controls");
         ImGui::Text("Player View: W/S (forward/back), A/D (turn)");
         ImGui::Text("God View: Free camera with mouse + WASD");
@@ -226,6 +303,28 @@ int main()
             ImGui::Text("  Reorder:     %.3f", prof.cpuReorderMs);
         }
 
+        if(foliageRenderer.isOcclusionCullingEnabled()) {
+            ImGui::SeparatorText("Occlusion Culling");
+            ImGui::Text("  Visible:   %u", prof.occlusionVisible);
+            ImGui::Text("  Occluded:  %u", prof.occlusionOccluded);
+            ImGui::Text("  Recovered: %u", prof.occlusionRecovered);
+        }
+
+        ImGui::SeparatorText("Foliage Overdraw (player view)");
+        ImGui::Text("  Fragments shaded: %llu", (unsigned long long)prof.fragmentsShaded);
+        ImGui::Text("  Depth passed:     %llu", (unsigned long long)prof.samplesPassed);
+        if(prof.samplesPassed > 0) {
+            ImGui::Text("  Shaded / passed:  %.2f", (double)prof.fragmentsShaded / (double)prof.samplesPassed);
+        }
+
+        if(foliageRenderer.isStreaming()) {
+            ImGui::SeparatorText("Tile Streaming");
+            ImGui::Text("  Resident tiles: %u (%u loading)", prof.streamResidentTiles, prof.streamPendingTiles);
+            ImGui::Text("  Pool: %u / %u instances (%.0f%%)", prof.streamPoolInstances, prof.streamPoolCapacity,
+                        prof.streamPoolCapacity ? 100.0 * prof.streamPoolInstances / prof.streamPoolCapacity : 0.0);
+            ImGui::Text("  Uploaded: %.1f KB this frame", prof.streamUploadBytes / 1024.0);
+        }
+
         double otherCPU = lastFrameTotalMs - foliageSum;
         if(lastFrameTotalMs > 0.0) ImGui::Text("Other CPU: %.3f", otherCPU);
         ImGui::Separator();
@@ -233,6 +332,14 @@ int main()
         ImGui::Text("Loop: %.3f ms", prof.cpuCollisionLoopMs);
         ImGui::Text("Rebuild: %.3f ms", prof.cpuCollisionRebuildMs);
         ImGui::Text("Tests: %u  Hits: %u", prof.collisionTests, prof.collisionHits);
+
+        // Timestamp queries are read back a few frames late instead of stalling on the GPU
+        if(!gpuProfiler.results().empty()) {
+            ImGui::SeparatorText("Frame Profiling (GPU ms)");
+            for(const GPUProfiler::ScopeResult& scope : gpuProfiler.results()) {
+                ImGui::Text("%*s%-*s %.3f", scope.depth * 2, "", 20 - scope.depth * 2, scope.name, scope.ms);
+            }
+        }
         ImGui::End();
 
         // Update lastFrameTotalMs at end of UI build (using previous frameStartCPU)
@@ -261,25 +368,42 @@ int main()
         //make playerProjection's range smaller to display the culling mechanism
         glm::mat4 playerProjection = glm::perspective(glm::radians(playerCamera.Zoom), aspectHalf, 0.1f, 100.0f);
 
+        // Foliage is culled once against the player frustum and drawn in both views
+        foliageRenderer.cull(playerView, playerProjection, playerCamera.Position);
+
         // God view
         glViewport(0, 0, SCR_WIDTH/2, SCR_HEIGHT);
-        proceduralGrid.render(godView, godProjection);
-        foliageRenderer.render(godView, godProjection, godCamera.Position,
-                    playerView, playerProjection, playerCamera.Position);
-        slimeCharacter.render(godView, godProjection);
+        {
+            GPUProfileScope scope(&gpuProfiler, "Grid");
+            proceduralGrid.render(godView, godProjection);
+        }
+        foliageRenderer.draw(godView, godProjection, godCamera.Position);
+        {
+            GPUProfileScope scope(&gpuProfiler, "Slime");
+            slimeCharacter.render(godView, godProjection);
+        }
 
         // Player view
         glViewport(SCR_WIDTH/2, 0, SCR_WIDTH/2, SCR_HEIGHT);
-        proceduralGrid.render(playerView, playerProjection);
-        foliageRenderer.render(playerView, playerProjection, playerCamera.Position,
-                    playerView, playerProjection, playerCamera.Position);
-        slimeCharacter.render(playerView, playerProjection);
+        {
+            GPUProfileScope scope(&gpuProfiler, "Grid");
+            proceduralGrid.render(playerView, playerProjection);
+        }
+        foliageRenderer.draw(playerView, playerProjection, playerCamera.Position);
+        {
+            GPUProfileScope scope(&gpuProfiler, "Slime");
+            slimeCharacter.render(playerView, playerProjection);
+        }
 
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
         // Render ImGui
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            GPUProfileScope scope(&gpuProfiler, "ImGui");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        gpuProfiler.end();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -293,6 +417,52 @@ int main()
     return 0;
 }
 
+// Repeats the largest sample set into a tiledWorldRepeat^2 field and cuts it into tile files
+static bool ensureTiledWorld(const std::string& manifestPath)
+{
+    std::ifstream existing(manifestPath);
+    if (existing.good())
+        return true;
+
+    std::vector<SpatialSamplePoint> base;
+    if (!SpatialSampleLoader::loadSS2File(sampleFiles.back(), base))
+        return false;
+    glm::vec2 minXZ(base[0].position.x, base[0].position.z);
+    glm::vec2 maxXZ = minXZ;
+    for (const auto& sample : base) {
+        minXZ = glm::min(minXZ, glm::vec2(sample.position.x, sample.position.z));
+        maxXZ = glm::max(maxXZ, glm::vec2(sample.position.x, sample.position.z));
+    }
+    glm::vec2 extent = maxXZ - minXZ;
+
+    std::vector<SpatialSamplePoint> world;
+    world.reserve(base.size() * tiledWorldRepeat * tiledWorldRepeat);
+    for (int z = 0; z < tiledWorldRepeat; z++) {
+        for (int x = 0; x < tiledWorldRepeat; x++) {
+            // copies centered on the origin, where the player starts
+            glm::vec2 offset = (glm::vec2((float)x, (float)z) - 0.5f * (tiledWorldRepeat - 1)) * extent;
+            for (SpatialSamplePoint sample : base) {
+                sample.position.x += offset.x;
+                sample.position.z += offset.y;
+                world.push_back(sample);
+            }
+        }
+    }
+    return SpatialSampleLoader::writeTileSet(world, tiledWorldTileSize, manifestPath);
+}
+
+void loadSampleSet(int index)
+{
+    if (index < (int)sampleFiles.size()) {
+        // built on a worker thread, the current set stays on screen until it is ready
+        foliageRenderer.loadPoissonSamplesAsync(sampleFiles[index]);
+        return;
+    }
+    if (!ensureTiledWorld(tiledWorldManifest) || !foliageRenderer.loadTiledWorld(tiledWorldManifest)) {
+        std::cerr << "Failed to load tiled world " << tiledWorldManifest << std::endl;
+    }
+}
+
 void processInput(GLFWwindow *window)
 {
     if (cameraMode == CameraMode::God) {
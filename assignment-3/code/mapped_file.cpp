@@ -0,0 +1,74 @@
+#include "mapped_file.h"
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : m_mapping(nullptr), m_size(0)
+#ifdef _WIN32
+    , m_fileHandle(INVALID_HANDLE_VALUE), m_mapHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+#ifdef _WIN32
+    m_fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (m_fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_fileHandle, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    m_mapHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_mapping = m_mapHandle ? MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!m_mapping) {
+        std::cerr << "Failed to map file: " << filename << std::endl;
+        close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    // empty files cannot be mapped
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << filename << std::endl;
+        return false;
+    }
+    m_mapping = mapping;
+    m_size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (m_mapping) UnmapViewOfFile(m_mapping);
+    if (m_mapHandle) CloseHandle(m_mapHandle);
+    if (m_fileHandle != INVALID_HANDLE_VALUE) CloseHandle(m_fileHandle);
+    m_mapHandle = nullptr;
+    m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (m_mapping) munmap(m_mapping, m_size);
+#endif
+    m_mapping = nullptr;
+    m_size = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file (mmap, or a file mapping on Windows)
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename);
+    void close();
+
+    const char* data() const { return static_cast<const char*>(m_mapping); }
+    size_t size() const { return m_size; }
+    bool isOpen() const { return m_mapping != nullptr; }
+
+private:
+    void* m_mapping;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_fileHandle;
+    void* m_mapHandle;
+#endif
+};
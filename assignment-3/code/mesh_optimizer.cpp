@@ -0,0 +1,225 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace MeshOptimizer {
+
+namespace {
+
+// LRU size the triangle order is scored against; larger than the FIFO used for
+// analysis so the order holds up on hardware with bigger caches
+const int SCORE_CACHE_SIZE = 32;
+
+float vertexScore(int cachePosition, unsigned int liveTriangles) {
+    if (liveTriangles == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices share a score so its edges are not favoured over each other
+        if (cachePosition < 3) score = 0.75f;
+        else score = std::pow(1.0f - (float)(cachePosition - 3) / (SCORE_CACHE_SIZE - 3), 1.5f);
+    }
+    // Boost vertices with few triangles left so they get finished off instead of re-fetched later
+    return score + 2.0f * std::pow((float)liveTriangles, -0.5f);
+}
+
+glm::vec3 readPosition(const float* positions, size_t stride, unsigned int index) {
+    const float* p = positions + (size_t)index * stride;
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indices.size() < 3 || vertexCount == 0) return stats;
+    // FIFO: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+    std::vector<long long> loadedAt(vertexCount, -(long long)cacheSize - 1);
+    std::vector<bool> referenced(vertexCount, false);
+    long long misses = 0;
+    size_t referencedCount = 0;
+    for (unsigned int index : indices) {
+        if (misses - loadedAt[index] > (long long)cacheSize - 1) {
+            loadedAt[index] = misses;
+            misses++;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            referencedCount++;
+        }
+    }
+    stats.acmr = (float)misses / (float)(indices.size() / 3);
+    stats.atvr = (float)misses / (float)referencedCount;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0) return;
+
+    // Per-vertex lists of triangles not yet emitted
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) liveTriangles[indices[i]]++;
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    {
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) scores[v] = vertexScore(-1, liveTriangles[v]);
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(SCORE_CACHE_SIZE + 3);
+    nextCache.reserve(SCORE_CACHE_SIZE + 3);
+    size_t scanCursor = 0;
+    long long best = -1;
+    while (result.size() < triangleCount * 3) {
+        if (best < 0) {
+            // Nothing adjacent to the cache is left: restart at the next unemitted triangle
+            while (emitted[scanCursor]) scanCursor++;
+            best = (long long)scanCursor;
+        }
+        const unsigned int* tri = &indices[(size_t)best * 3];
+        emitted[(size_t)best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            result.push_back(v);
+            // Drop the triangle from the vertex's live list
+            unsigned int* begin = &adjacency[adjacencyOffset[v]];
+            unsigned int* end = begin + liveTriangles[v];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            liveTriangles[v]--;
+            nextCache.push_back(v);
+        }
+        for (unsigned int v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) nextCache.push_back(v);
+        }
+        // Rescore everything that was or is in the cache, tracking the best touched triangle
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < (size_t)SCORE_CACHE_SIZE ? (int)i : -1;
+        }
+        for (unsigned int v : nextCache) {
+            float delta = vertexScore(cachePosition[v], liveTriangles[v]) - scores[v];
+            scores[v] += delta;
+            for (unsigned int a = 0; a < liveTriangles[v]; a++) {
+                triangleScores[adjacency[adjacencyOffset[v] + a]] += delta;
+            }
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : nextCache) {
+            for (unsigned int a = 0; a < liveTriangles[v]; a++) {
+                unsigned int t = adjacency[adjacencyOffset[v] + a];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size() > (size_t)SCORE_CACHE_SIZE) nextCache.resize(SCORE_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const float* positions, size_t positionStride,
+                      size_t vertexCount, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+    const unsigned int cacheSize = 16;
+
+    // Cluster starts are triangles that miss on all three vertices: the cache is cold
+    // there anyway, so clusters can be reordered without adding misses
+    std::vector<size_t> clusterStart;
+    {
+        std::vector<long long> loadedAt(vertexCount, -(long long)cacheSize - 1);
+        long long misses = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int triangleMisses = 0;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                if (misses - loadedAt[v] > (long long)cacheSize - 1) {
+                    loadedAt[v] = misses;
+                    misses++;
+                    triangleMisses++;
+                }
+            }
+            if (triangleMisses == 3 || t == 0) clusterStart.push_back(t);
+        }
+    }
+    if (clusterStart.size() < 2) return;
+    clusterStart.push_back(triangleCount);
+
+    // Area-weighted centroids and normals
+    struct Cluster { size_t first; size_t count; glm::vec3 centroid; glm::vec3 normal; float sortKey; };
+    std::vector<Cluster> clusters(clusterStart.size() - 1);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = clusters[c];
+        cluster.first = clusterStart[c];
+        cluster.count = clusterStart[c + 1] - clusterStart[c];
+        cluster.centroid = glm::vec3(0.0f);
+        cluster.normal = glm::vec3(0.0f);
+        float clusterArea = 0.0f;
+        for (size_t t = cluster.first; t < cluster.first + cluster.count; t++) {
+            glm::vec3 a = readPosition(positions, positionStride, indices[t * 3]);
+            glm::vec3 b = readPosition(positions, positionStride, indices[t * 3 + 1]);
+            glm::vec3 d = readPosition(positions, positionStride, indices[t * 3 + 2]);
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float area = glm::length(n) * 0.5f;
+            cluster.centroid += (a + b + d) * (area / 3.0f);
+            cluster.normal += n;
+            clusterArea += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f) cluster.centroid /= clusterArea;
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // Clusters facing away from the centre occlude the rest from most directions: draw them first
+    for (Cluster& cluster : clusters) {
+        float length = glm::length(cluster.normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + (cluster.first + cluster.count) * 3);
+    }
+    // Trailing indices that do not form a triangle stay where they were
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    if (analyzeVertexCache(result, vertexCount, cacheSize).acmr <= analyzeVertexCache(indices, vertexCount, cacheSize).acmr * threshold) {
+        indices.swap(result);
+    }
+}
+
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount) {
+    std::vector<unsigned int> remap(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (unsigned int& index : indices) {
+        if (remap[index] == ~0u) remap[index] = next++;
+        index = remap[index];
+    }
+    return remap;
+}
+
+} // namespace MeshOptimizer
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Triangle and vertex reordering for indexed triangle lists. Positions are read
+// as 3 floats every positionStride floats.
+namespace MeshOptimizer {
+
+struct VertexCacheStats {
+    float acmr = 0.0f; // post-transform cache misses per triangle (0.5 ideal, 3 worst)
+    float atvr = 0.0f; // misses per referenced vertex (1 ideal)
+};
+
+// FIFO cache simulation, roughly what current GPUs do after the vertex shader
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Forsyth's linear-speed vertex cache optimization
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// View-independent overdraw reduction (Sander et al.): cuts the cache-ordered list into
+// clusters at cache restarts and draws outward-facing clusters first. Keeps the result
+// only while its ACMR stays within threshold times the input's.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const float* positions, size_t positionStride,
+                      size_t vertexCount, float threshold = 1.05f);
+
+// Vertices in order of first use; returns the old-to-new remap (~0u for unused vertices)
+// and rewrites indices. The caller moves its vertex data with the remap.
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+} // namespace MeshOptimizer
@@ -1,136 +1,365 @@
 #include "obj_loader.h"
 #include <fstream>
-#include <sstream>
 #include <iostream>
-#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include "mapped_file.h"
+#include "mesh_optimizer.h"
+
+// Cooked mesh: header, then vertexCount Vertex records, then indexCount indices
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;  // OBJ size and modification time the cache was built from
+    int64_t sourceMtime;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+static const char MESH_CACHE_MAGIC[4] = {'F', 'M', 'S', 'H'};
+static const uint32_t MESH_CACHE_VERSION = 3; // 2: vertices deduped on index triples, 3: cache-optimized order
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex is stored as 8 packed floats in the mesh cache");
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    size = (uint64_t)info.st_size;
+    mtime = (int64_t)info.st_mtime;
+    return true;
+}
 
 bool SimpleOBJLoader::loadOBJ(const std::string& path, Mesh& mesh) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open OBJ file: " << path << std::endl;
+    const std::string cachePath = path + ".mesh";
+    if (loadMeshCache(cachePath, path, mesh)) {
+        return true;
+    }
+    if (!parseOBJ(path, mesh)) {
         return false;
     }
+    optimizeMesh(path, mesh);
+    writeMeshCache(cachePath, path, mesh);
+    return true;
+}
 
-    std::vector<glm::vec3> temp_positions;
-    std::vector<glm::vec2> temp_texCoords;
-    std::vector<glm::vec3> temp_normals;
-    
-    std::vector<int> positionIndices, texCoordIndices, normalIndices;
-    
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string prefix;
-        iss >> prefix;
-        
-        if (prefix == "v") {
-            glm::vec3 position;
-            iss >> position.x >> position.y >> position.z;
-            temp_positions.push_back(position);
+void SimpleOBJLoader::optimizeMesh(const std::string& path, Mesh& mesh) {
+    if (mesh.indices.size() < 3) return;
+    MeshOptimizer::VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    MeshOptimizer::optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    MeshOptimizer::optimizeOverdraw(mesh.indices, &mesh.vertices[0].position.x, sizeof(Vertex) / sizeof(float), mesh.vertices.size());
+    std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(mesh.indices, mesh.vertices.size());
+    std::vector<Vertex> vertices(mesh.vertices.size());
+    size_t used = 0;
+    for (size_t i = 0; i < remap.size(); i++) {
+        if (remap[i] == ~0u) continue;
+        vertices[remap[i]] = mesh.vertices[i];
+        used++;
+    }
+    vertices.resize(used);
+    mesh.vertices.swap(vertices);
+    MeshOptimizer::VertexCacheStats after = MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    std::cout << "Optimized " << path << ": ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+bool SimpleOBJLoader::loadMeshCache(const std::string& cachePath, const std::string& sourcePath, Mesh& mesh) {
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    MappedFile file;
+    if (!sourceStamp(sourcePath, sourceSize, sourceMtime) || !file.open(cachePath)) {
+        return false;
+    }
+    MeshCacheHeader header;
+    if (file.size() < sizeof(header)) return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION) return false;
+    if (header.sourceSize != sourceSize || header.sourceMtime != sourceMtime) {
+        std::cout << "Mesh cache out of date, rebuilding: " << cachePath << std::endl;
+        return false;
+    }
+    size_t vertexBytes = (size_t)header.vertexCount * sizeof(Vertex);
+    size_t indexBytes = (size_t)header.indexCount * sizeof(unsigned int);
+    if (file.size() != sizeof(header) + vertexBytes + indexBytes) {
+        std::cerr << "Mesh cache has the wrong size, rebuilding: " << cachePath << std::endl;
+        return false;
+    }
+
+    const char* vertexBlock = file.data() + sizeof(header);
+    mesh.vertices.resize(header.vertexCount);
+    mesh.indices.resize(header.indexCount);
+    if (vertexBytes) std::memcpy(mesh.vertices.data(), vertexBlock, vertexBytes);
+    if (indexBytes) std::memcpy(mesh.indices.data(), vertexBlock + vertexBytes, indexBytes);
+    mesh.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mesh.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+void SimpleOBJLoader::writeMeshCache(const std::string& cachePath, const std::string& sourcePath, const Mesh& mesh) {
+    MeshCacheHeader header;
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    if (!sourceStamp(sourcePath, header.sourceSize, header.sourceMtime)) return;
+    header.vertexCount = (uint32_t)mesh.vertices.size();
+    header.indexCount = (uint32_t)mesh.indices.size();
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = mesh.boundsMin[i];
+        header.boundsMax[i] = mesh.boundsMax[i];
+    }
+
+    std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not write mesh cache: " << cachePath << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+    file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+    if (!file.good()) {
+        std::cerr << "Could not write mesh cache: " << cachePath << std::endl;
+    }
+}
+
+namespace {
+
+// Face corner as 0-based indices into the merged arrays; -1 = not given.
+// Negative OBJ indices count back from the chunk's own elements (possibly into
+// earlier chunks), so they stay chunk-local, flagged in relative, until merged.
+enum { RELATIVE_V = 1, RELATIVE_VT = 2, RELATIVE_VN = 4 };
+struct ObjCorner {
+    int v, vt, vn;
+    int relative;
+};
+
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners; // three per triangle
+};
+
+const size_t OBJ_PARALLEL_MIN_BYTES = 1 << 20; // smaller files parse on the calling thread
+const size_t OBJ_CHUNK_MIN_BYTES = 256 * 1024;
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+inline const char* nextLine(const char* p, const char* end) {
+    const void* newline = std::memchr(p, '\n', (size_t)(end - p));
+    return newline ? static_cast<const char*>(newline) + 1 : end;
+}
+
+// Decimal float without allocation or locale: [+-]digits[.digits][(e|E)[+-]digits]
+const char* parseFloat(const char* p, const char* end, float& out) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    p = skipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; p < end && isDigit(*p); ++p, ++digits) {
+        if (mantissa < 1000000000000000000ull) mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        else exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, ++digits) {
+            if (mantissa < 1000000000000000000ull) { mantissa = mantissa * 10 + (uint64_t)(*p - '0'); exponent--; }
         }
-        else if (prefix == "vt") {
-            glm::vec2 texCoord;
-            iss >> texCoord.x >> texCoord.y;
-            temp_texCoords.push_back(texCoord);
+    }
+    if (digits == 0) {
+        out = 0.0f;
+        return p;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExp = false;
+        if (q < end && (*q == '-' || *q == '+')) negativeExp = (*q++ == '-');
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); ++q) if (e < 10000) e = e * 10 + (*q - '0');
+            exponent += negativeExp ? -e : e;
+            p = q;
         }
-        else if (prefix == "vn") {
+    }
+    double value = (double)mantissa;
+    if (exponent < 0) value = exponent >= -22 ? value / powers[-exponent] : value * std::pow(10.0, exponent);
+    else if (exponent > 0) value = exponent <= 22 ? value * powers[exponent] : value * std::pow(10.0, exponent);
+    out = (float)(negative ? -value : value);
+    return p;
+}
+
+const char* parseInt(const char* p, const char* end, int& out, bool& present) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    present = p < end && isDigit(*p);
+    int value = 0;
+    for (; p < end && isDigit(*p); ++p) value = value * 10 + (*p - '0');
+    out = negative ? -value : value;
+    return p;
+}
+
+// 1-based or negative (relative to the elements parsed so far) OBJ index
+inline int resolveIndex(int index, bool present, size_t localCount, int relativeBit, int& relative) {
+    if (!present || index == 0) return -1;
+    if (index > 0) return index - 1;
+    relative |= relativeBit;
+    return (int)localCount + index;
+}
+
+void parseChunk(const char* p, const char* end, ObjChunk& chunk) {
+    std::vector<ObjCorner> polygon;
+    while (p < end) {
+        const char* line = skipSpaces(p, end);
+        const char* next = nextLine(line, end);
+        if (line + 1 < end && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            glm::vec3 position;
+            const char* q = parseFloat(line + 1, next, position.x);
+            q = parseFloat(q, next, position.y);
+            parseFloat(q, next, position.z);
+            chunk.positions.push_back(position);
+        } else if (line + 2 < end && line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t')) {
+            glm::vec2 texCoord;
+            parseFloat(parseFloat(line + 2, next, texCoord.x), next, texCoord.y);
+            chunk.texCoords.push_back(texCoord);
+        } else if (line + 2 < end && line[0] == 'v' && line[1] == 'n' && (line[2] == ' ' || line[2] == '\t')) {
             glm::vec3 normal;
-            iss >> normal.x >> normal.y >> normal.z;
-            temp_normals.push_back(normal);
-        }
-        else if (prefix == "f") {
-            std::string vertex1, vertex2, vertex3;
-            iss >> vertex1 >> vertex2 >> vertex3;
-            
-            auto parseVertex = [&](const std::string& vertexStr) {
-                std::istringstream vertexStream(vertexStr);
-                std::string component;
-                
-                // Position index
-                std::getline(vertexStream, component, '/');
-                if (!component.empty()) {
-                    positionIndices.push_back(std::stoi(component) - 1);
-                }
-                
-                // Texture coordinate index
-                std::getline(vertexStream, component, '/');
-                if (!component.empty()) {
-                    texCoordIndices.push_back(std::stoi(component) - 1);
-                } else {
-                    texCoordIndices.push_back(-1);
-                }
-                
-                // Normal index
-                std::getline(vertexStream, component);
-                if (!component.empty()) {
-                    normalIndices.push_back(std::stoi(component) - 1);
-                } else {
-                    normalIndices.push_back(-1);
+            const char* q = parseFloat(line + 2, next, normal.x);
+            q = parseFloat(q, next, normal.y);
+            parseFloat(q, next, normal.z);
+            chunk.normals.push_back(normal);
+        } else if (line + 1 < end && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            // v, v/vt, v//vn or v/vt/vn corners, any number per face
+            polygon.clear();
+            const char* q = skipSpaces(line + 1, next);
+            while (q < next && *q != '\n' && *q != '\r' && *q != '#') {
+                int v = 0, vt = 0, vn = 0;
+                bool hasV = false, hasVt = false, hasVn = false;
+                q = parseInt(q, next, v, hasV);
+                if (q < next && *q == '/') {
+                    q = parseInt(q + 1, next, vt, hasVt);
+                    if (q < next && *q == '/') q = parseInt(q + 1, next, vn, hasVn);
                 }
-            };
-            
-            parseVertex(vertex1);
-            parseVertex(vertex2);
-            parseVertex(vertex3);
+                if (!hasV) break; // malformed corner, keep what was read
+                ObjCorner corner;
+                corner.relative = 0;
+                corner.v = resolveIndex(v, hasV, chunk.positions.size(), RELATIVE_V, corner.relative);
+                corner.vt = resolveIndex(vt, hasVt, chunk.texCoords.size(), RELATIVE_VT, corner.relative);
+                corner.vn = resolveIndex(vn, hasVn, chunk.normals.size(), RELATIVE_VN, corner.relative);
+                polygon.push_back(corner);
+                while (q < next && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r') ++q;
+                q = skipSpaces(q, next);
+            }
+            // Fan triangulation
+            for (size_t i = 2; i < polygon.size(); i++) {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[i - 1]);
+                chunk.corners.push_back(polygon[i]);
+            }
         }
+        p = next;
     }
-    
-    // Process vertices and create final mesh
-    processVertex(temp_positions, temp_texCoords, temp_normals,
-                 positionIndices, texCoordIndices, normalIndices,
-                 mesh.vertices, mesh.indices);
-    
-    return true;
 }
 
-void SimpleOBJLoader::processVertex(const std::vector<glm::vec3>& positions,
-                                   const std::vector<glm::vec2>& texCoords,
-                                   const std::vector<glm::vec3>& normals,
-                                   const std::vector<int>& posIndices,
-                                   const std::vector<int>& texIndices,
-                                   const std::vector<int>& normalIndices,
-                                   std::vector<Vertex>& vertices,
-                                   std::vector<unsigned int>& indices) {
-    
-    std::unordered_map<std::string, unsigned int> uniqueVertices;
-    
-    for (size_t i = 0; i < posIndices.size(); i++) {
-        Vertex vertex;
-        
-        // Position
-        if (posIndices[i] >= 0 && posIndices[i] < positions.size()) {
-            vertex.position = positions[posIndices[i]];
+
+inline size_t hashCorner(const ObjCorner& c) {
+    return ((size_t)(unsigned)c.v * 73856093u) ^ ((size_t)(unsigned)c.vt * 19349663u) ^ ((size_t)(unsigned)c.vn * 83492791u);
+}
+
+} // namespace
+
+bool SimpleOBJLoader::parseOBJ(const std::string& path, Mesh& mesh) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to open OBJ file: " << path << std::endl;
+        return false;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Large files are cut at line breaks and parsed in parallel
+    size_t chunkCount = 1;
+    if (file.size() >= OBJ_PARALLEL_MIN_BYTES) {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        chunkCount = std::min(threads, file.size() / OBJ_CHUNK_MIN_BYTES);
+    }
+    std::vector<const char*> bounds(1, begin);
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* split = begin + file.size() * i / chunkCount;
+        if (split <= bounds.back()) continue;
+        bounds.push_back(nextLine(split, end));
+    }
+    bounds.push_back(end);
+    std::vector<ObjChunk> chunks(bounds.size() - 1);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        workers.push_back(std::thread(parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i])));
+    }
+    parseChunk(bounds[0], bounds[1], chunks[0]);
+    for (auto& worker : workers) worker.join();
+
+    // Merge the chunks in file order, resolving chunk-relative indices
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners;
+    for (auto& chunk : chunks) {
+        int positionOffset = (int)positions.size();
+        int texCoordOffset = (int)texCoords.size();
+        int normalOffset = (int)normals.size();
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (ObjCorner corner : chunk.corners) {
+            if (corner.relative & RELATIVE_V) corner.v += positionOffset;
+            if (corner.relative & RELATIVE_VT) corner.vt += texCoordOffset;
+            if (corner.relative & RELATIVE_VN) corner.vn += normalOffset;
+            corner.relative = 0;
+            corners.push_back(corner);
         }
-        
-        // Texture coordinates
-        if (i < texIndices.size() && texIndices[i] >= 0 && texIndices[i] < texCoords.size()) {
-            vertex.texCoords = texCoords[texIndices[i]];
-        } else {
-            vertex.texCoords = glm::vec2(0.0f);
+        chunk = ObjChunk();
+    }
+
+    // Dedupe on the (v, vt, vn) triple, open addressing with linear probing
+    size_t tableSize = 16;
+    while (tableSize < corners.size() * 2) tableSize <<= 1;
+    std::vector<int> table(tableSize, -1);
+    std::vector<ObjCorner> uniqueCorners;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.indices.reserve(corners.size());
+    for (const ObjCorner& corner : corners) {
+        size_t slot = hashCorner(corner) & (tableSize - 1);
+        while (table[slot] >= 0) {
+            const ObjCorner& other = uniqueCorners[table[slot]];
+            if (other.v == corner.v && other.vt == corner.vt && other.vn == corner.vn) break;
+            slot = (slot + 1) & (tableSize - 1);
         }
-        
-        // Normals
-        if (i < normalIndices.size() && normalIndices[i] >= 0 && normalIndices[i] < normals.size()) {
-            vertex.normal = normals[normalIndices[i]];
-        } else {
-            vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f); // Default normal
+        if (table[slot] < 0) {
+            Vertex vertex;
+            vertex.position = corner.v >= 0 && corner.v < (int)positions.size() ? positions[corner.v] : glm::vec3(0.0f);
+            vertex.texCoords = corner.vt >= 0 && corner.vt < (int)texCoords.size() ? texCoords[corner.vt] : glm::vec2(0.0f);
+            vertex.normal = corner.vn >= 0 && corner.vn < (int)normals.size() ? normals[corner.vn] : glm::vec3(0.0f, 1.0f, 0.0f); // Default normal
+            table[slot] = (int)mesh.vertices.size();
+            uniqueCorners.push_back(corner);
+            mesh.vertices.push_back(vertex);
         }
-        
-        // Create unique key for vertex
-        std::string key = std::to_string(vertex.position.x) + "," +
-                         std::to_string(vertex.position.y) + "," +
-                         std::to_string(vertex.position.z) + "," +
-                         std::to_string(vertex.texCoords.x) + "," +
-                         std::to_string(vertex.texCoords.y) + "," +
-                         std::to_string(vertex.normal.x) + "," +
-                         std::to_string(vertex.normal.y) + "," +
-                         std::to_string(vertex.normal.z);
-        
-        if (uniqueVertices.count(key) == 0) {
-            uniqueVertices[key] = static_cast<unsigned int>(vertices.size());
-            vertices.push_back(vertex);
+        mesh.indices.push_back((unsigned int)table[slot]);
+    }
+
+    if (!mesh.vertices.empty()) {
+        mesh.boundsMin = mesh.boundsMax = mesh.vertices[0].position;
+        for (const auto& vertex : mesh.vertices) {
+            mesh.boundsMin = glm::min(mesh.boundsMin, vertex.position);
+            mesh.boundsMax = glm::max(mesh.boundsMax, vertex.position);
         }
-        
-        indices.push_back(uniqueVertices[key]);
     }
+    return true;
 }
@@ -14,19 +14,19 @@ struct Mesh {
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::string texturePath;
+    glm::vec3 boundsMin = glm::vec3(0.0f); // vertex position AABB
+    glm::vec3 boundsMax = glm::vec3(0.0f);
 };
 
 class SimpleOBJLoader {
 public:
+    // Prefers the cooked "<path>.mesh" cache next to the OBJ, rewriting it when the OBJ changed
     static bool loadOBJ(const std::string& path, Mesh& mesh);
     
 private:
-    static void processVertex(const std::vector<glm::vec3>& positions,
-                             const std::vector<glm::vec2>& texCoords,
-                             const std::vector<glm::vec3>& normals,
-                             const std::vector<int>& posIndices,
-                             const std::vector<int>& texIndices,
-                             const std::vector<int>& normalIndices,
-                             std::vector<Vertex>& vertices,
-                             std::vector<unsigned int>& indices);
+    static bool parseOBJ(const std::string& path, Mesh& mesh);
+    // Triangle order for vertex cache and overdraw, then vertex order for fetch locality
+    static void optimizeMesh(const std::string& path, Mesh& mesh);
+    static bool loadMeshCache(const std::string& cachePath, const std::string& sourcePath, Mesh& mesh);
+    static void writeMeshCache(const std::string& cachePath, const std::string& sourcePath, const Mesh& mesh);
 };
@@ -14,6 +14,8 @@ public:
     void render(const glm::mat4& view, const glm::mat4& projection);
     
     glm::vec3 getPosition() const { return m_position; }
+    // Scripted placement for the benchmark; update() carries on walking from here
+    void setPosition(const glm::vec3& position) { m_position = position; }
     
 private:
     glm::vec3 m_position;
@@ -1,42 +1,138 @@
 #include "spatial_sample_loader.h"
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <cmath>
+#include <cstring>
 
-bool SpatialSampleLoader::loadSS2File(const std::string& filename, std::vector<SpatialSamplePoint>& samples) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
+bool MappedSS2File::open(const std::string& filename) {
+    close();
+    if (!m_file.open(filename)) {
         std::cerr << "Failed to open spatial sample file: " << filename << std::endl;
         return false;
     }
-    
-    int numSamples;
-    file.read(reinterpret_cast<char*>(&numSamples), sizeof(int));
-    
-    if (numSamples <= 0) {
-        std::cerr << "Invalid number of samples: " << numSamples << std::endl;
+    size_t fileSize = m_file.size();
+    int numSamples = 0;
+    if (fileSize >= sizeof(int)) std::memcpy(&numSamples, m_file.data(), sizeof(int));
+    size_t payload = fileSize >= sizeof(int) ? fileSize - sizeof(int) : 0;
+    if (numSamples <= 0 || payload % sizeof(SpatialSamplePoint) != 0 ||
+        (size_t)numSamples != payload / sizeof(SpatialSamplePoint)) {
+        std::cerr << "Invalid number of samples: " << numSamples << " for " << fileSize << " bytes in " << filename << std::endl;
+        close();
+        return false;
+    }
+    m_samples = reinterpret_cast<const SpatialSamplePoint*>(m_file.data() + sizeof(int));
+    m_count = (size_t)numSamples;
+    return true;
+}
+
+void MappedSS2File::close() {
+    m_file.close();
+    m_samples = nullptr;
+    m_count = 0;
+}
+
+bool SpatialSampleLoader::loadSS2File(const std::string& filename, std::vector<SpatialSamplePoint>& samples) {
+    MappedSS2File file;
+    if (!file.open(filename)) {
         return false;
     }
-    
-    samples.clear();
-    samples.reserve(numSamples);
-    
-    for (int i = 0; i < numSamples; i++) {
-        SpatialSamplePoint sample;
-        
-        // Read position
-        file.read(reinterpret_cast<char*>(&sample.position.x), sizeof(float));
-        file.read(reinterpret_cast<char*>(&sample.position.y), sizeof(float));
-        file.read(reinterpret_cast<char*>(&sample.position.z), sizeof(float));
-        
-        // Read rotation
-        file.read(reinterpret_cast<char*>(&sample.rotation.x), sizeof(float));
-        file.read(reinterpret_cast<char*>(&sample.rotation.y), sizeof(float));
-        file.read(reinterpret_cast<char*>(&sample.rotation.z), sizeof(float));
-        
-        samples.push_back(sample);
-    }
-    
-    file.close();
+    samples.assign(file.begin(), file.end());
     std::cout << "Loaded " << samples.size() << " spatial samples from " << filename << std::endl;
     return true;
 }
+
+bool SpatialSampleLoader::saveSS2File(const std::string& filename, const std::vector<SpatialSamplePoint>& samples) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to create spatial sample file: " << filename << std::endl;
+        return false;
+    }
+
+    int numSamples = (int)samples.size();
+    file.write(reinterpret_cast<const char*>(&numSamples), sizeof(int));
+    for (const auto& sample : samples) {
+        file.write(reinterpret_cast<const char*>(&sample.position.x), sizeof(float));
+        file.write(reinterpret_cast<const char*>(&sample.position.y), sizeof(float));
+        file.write(reinterpret_cast<const char*>(&sample.position.z), sizeof(float));
+        file.write(reinterpret_cast<const char*>(&sample.rotation.x), sizeof(float));
+        file.write(reinterpret_cast<const char*>(&sample.rotation.y), sizeof(float));
+        file.write(reinterpret_cast<const char*>(&sample.rotation.z), sizeof(float));
+    }
+    return file.good();
+}
+
+static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+bool SpatialSampleLoader::loadTileManifest(const std::string& manifestPath, SpatialSampleTileSet& tileSet) {
+    std::ifstream file(manifestPath);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open tile manifest: " << manifestPath << std::endl;
+        return false;
+    }
+
+    std::string directory = directoryOf(manifestPath);
+    tileSet.tileSize = 0.0f;
+    tileSet.tiles.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword) || keyword[0] == '#') continue;
+        if (keyword == "tile_size") {
+            tokens >> tileSet.tileSize;
+        } else if (keyword == "tile") {
+            SpatialSampleTile tile;
+            std::string name;
+            if (!(tokens >> tile.x >> tile.z >> tile.sampleCount >> name)) {
+                std::cerr << "Malformed tile entry in " << manifestPath << ": " << line << std::endl;
+                return false;
+            }
+            tile.path = directory + name;
+            tileSet.tiles.push_back(tile);
+        }
+    }
+
+    if (tileSet.tileSize <= 0.0f || tileSet.tiles.empty()) {
+        std::cerr << "Tile manifest " << manifestPath << " has no tile size or tiles" << std::endl;
+        return false;
+    }
+    std::cout << "Loaded tile manifest with " << tileSet.tiles.size() << " tiles from " << manifestPath << std::endl;
+    return true;
+}
+
+bool SpatialSampleLoader::writeTileSet(const std::vector<SpatialSamplePoint>& samples, float tileSize, const std::string& manifestPath) {
+    std::map<std::pair<int, int>, std::vector<SpatialSamplePoint>> tiles;
+    for (const auto& sample : samples) {
+        int x = (int)std::floor(sample.position.x / tileSize);
+        int z = (int)std::floor(sample.position.z / tileSize);
+        tiles[std::make_pair(x, z)].push_back(sample);
+    }
+
+    std::ofstream manifest(manifestPath);
+    if (!manifest.is_open()) {
+        std::cerr << "Failed to create tile manifest: " << manifestPath << std::endl;
+        return false;
+    }
+
+    // Tile files share the manifest's name so one set never overwrites another
+    std::string directory = directoryOf(manifestPath);
+    std::string stem = manifestPath.substr(directory.size());
+    size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos) stem = stem.substr(0, dot);
+
+    manifest << "tile_size " << tileSize << "\n";
+    for (const auto& tile : tiles) {
+        std::ostringstream name;
+        name << stem << "_" << tile.first.first << "_" << tile.first.second << ".ss2";
+        if (!saveSS2File(directory + name.str(), tile.second)) return false;
+        manifest << "tile " << tile.first.first << " " << tile.first.second << " "
+                 << tile.second.size() << " " << name.str() << "\n";
+    }
+    std::cout << "Wrote " << tiles.size() << " tiles of " << tileSize << " units to " << manifestPath << std::endl;
+    return manifest.good();
+}
@@ -3,13 +3,57 @@
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
+#include "mapped_file.h"
 
 struct SpatialSamplePoint {
     glm::vec3 position;
     glm::vec3 rotation;
 };
+// Same layout as a sample on disk, so a mapped file can be read in place
+static_assert(sizeof(SpatialSamplePoint) == 6 * sizeof(float), "SpatialSamplePoint must match the .ss2 sample layout");
+
+// Read-only .ss2 file mapped into memory. The samples are a view straight into
+// the mapping and stay valid until close() or destruction.
+class MappedSS2File {
+public:
+    MappedSS2File() : m_samples(nullptr), m_count(0) {}
+
+    // Fails unless the header count matches the file size exactly
+    bool open(const std::string& filename);
+    void close();
+
+    const SpatialSamplePoint* begin() const { return m_samples; }
+    const SpatialSamplePoint* end() const { return m_samples + m_count; }
+    const SpatialSamplePoint& operator[](size_t i) const { return m_samples[i]; }
+    size_t size() const { return m_count; }
+
+private:
+    MappedFile m_file;
+    const SpatialSamplePoint* m_samples;
+    size_t m_count;
+};
+
+// One tile of a streamed world: tile (x, z) covers [x, x+1) * tileSize on each axis
+struct SpatialSampleTile {
+    int x;
+    int z;
+    int sampleCount;
+    std::string path;
+};
+
+struct SpatialSampleTileSet {
+    float tileSize;
+    std::vector<SpatialSampleTile> tiles;
+};
 
 class SpatialSampleLoader {
 public:
     static bool loadSS2File(const std::string& filename, std::vector<SpatialSamplePoint>& samples);
+    static bool saveSS2File(const std::string& filename, const std::vector<SpatialSamplePoint>& samples);
+
+    // Tile manifest: "tile_size <size>" followed by "tile <x> <z> <count> <file>" lines,
+    // files relative to the manifest's directory
+    static bool loadTileManifest(const std::string& manifestPath, SpatialSampleTileSet& tileSet);
+    // Splits samples into per-tile .ss2 files next to the manifest and writes the manifest
+    static bool writeTileSet(const std::vector<SpatialSamplePoint>& samples, float tileSize, const std::string& manifestPath);
 };
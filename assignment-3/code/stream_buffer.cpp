@@ -0,0 +1,101 @@
+#include "stream_buffer.h"
+#include <iostream>
+#include <cstring>
+
+StreamBuffer::StreamBuffer()
+    : m_buffer(0), m_mapped(nullptr), m_frameSize(0), m_head(0), m_frame(0), m_overflowReported(false) {
+    for(int i = 0; i < FRAME_COUNT; ++i) m_fences[i] = 0;
+}
+
+StreamBuffer::~StreamBuffer() {
+    for(int i = 0; i < FRAME_COUNT; ++i) {
+        if(m_fences[i]) glDeleteSync(m_fences[i]);
+    }
+    if(m_buffer) {
+        if(m_mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+    }
+}
+
+bool StreamBuffer::initialize(GLsizeiptr bytesPerFrame) {
+    // 256 keeps every region start valid for any copy or binding offset
+    m_frameSize = (bytesPerFrame + 255) & ~(GLsizeiptr)255;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, m_frameSize * FRAME_COUNT, nullptr, flags);
+    m_mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_frameSize * FRAME_COUNT, flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if(!m_mapped) {
+        std::cerr << "Failed to map streaming buffer" << std::endl;
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        return false;
+    }
+    return true;
+}
+
+void StreamBuffer::nextFrame() {
+    if(!m_mapped) return;
+    if(m_fences[m_frame]) glDeleteSync(m_fences[m_frame]);
+    m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_frame = (m_frame + 1) % FRAME_COUNT;
+    m_head = 0;
+    // Only blocks when the GPU is more than FRAME_COUNT frames behind
+    if(m_fences[m_frame]) {
+        GLenum status = glClientWaitSync(m_fences[m_frame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while(status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(m_fences[m_frame], 0, 1000000);
+        }
+        glDeleteSync(m_fences[m_frame]);
+        m_fences[m_frame] = 0;
+    }
+}
+
+void* StreamBuffer::allocate(GLsizeiptr size, GLintptr& offset) {
+    offset = -1;
+    if(!m_mapped) return nullptr;
+    GLsizeiptr start = (m_head + 15) & ~(GLsizeiptr)15;
+    if(start + size > m_frameSize) {
+        if(!m_overflowReported) {
+            std::cerr << "Streaming buffer region full (" << m_frameSize << " bytes), using glBufferSubData" << std::endl;
+            m_overflowReported = true;
+        }
+        return nullptr;
+    }
+    offset = (GLintptr)m_frame * m_frameSize + start;
+    m_head = start + size;
+    return m_mapped + offset;
+}
+
+GLintptr StreamBuffer::write(const void* data, GLsizeiptr size) {
+    GLintptr offset;
+    void* dst = allocate(size, offset);
+    if(!dst) return -1;
+    std::memcpy(dst, data, (size_t)size);
+    return offset;
+}
+
+void StreamBuffer::copy(GLintptr offset, GLuint dst, GLintptr dstOffset, GLsizeiptr size) {
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, dstOffset, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::upload(GLuint dst, GLintptr dstOffset, const void* data, GLsizeiptr size) {
+    if(size <= 0) return;
+    GLintptr offset = write(data, size);
+    if(offset < 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, dstOffset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+    copy(offset, dst, dstOffset, size);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../include/glad/glad.h"
+
+// Persistently mapped upload ring. Each frame in flight owns one region that is
+// recycled only after the fence placed when the frame ended has signaled, so
+// writes never stall on or reallocate GPU storage.
+class StreamBuffer {
+public:
+    static const int FRAME_COUNT = 3;
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    bool initialize(GLsizeiptr bytesPerFrame);
+    bool isInitialized() const { return m_mapped != nullptr; }
+
+    // Fence the current region and move on to the next one
+    void nextFrame();
+
+    // Reserves size bytes of the current region for the caller to fill in place; returns the
+    // mapped pointer and its offset in buffer(), or nullptr when the region is full
+    void* allocate(GLsizeiptr size, GLintptr& offset);
+    // Copies data into the current region; returns its offset in buffer(), or -1 when the region is full
+    GLintptr write(const void* data, GLsizeiptr size);
+    // GPU-side copy from buffer() at offset into dst
+    void copy(GLintptr offset, GLuint dst, GLintptr dstOffset, GLsizeiptr size);
+    // write() followed by copy(); falls back to glBufferSubData when full
+    void upload(GLuint dst, GLintptr dstOffset, const void* data, GLsizeiptr size);
+
+    GLuint buffer() const { return m_buffer; }
+
+private:
+    GLuint m_buffer;
+    char* m_mapped;
+    GLsizeiptr m_frameSize;
+    GLsizeiptr m_head; // next free byte in the current region
+    int m_frame;
+    GLsync m_fences[FRAME_COUNT];
+    bool m_overflowReported;
+};
@@ -1,27 +1,49 @@
 #version 460 core
 
+// Float layout, or quantized: aPos unorm16 in the mesh box, aNormal.xy octahedral snorm16, aTexCoord half
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 
-struct GPUInstancePacked { mat4 model; vec4 info; }; // info.x = texture index, info.y = meshType
+struct GPUInstancePacked { vec3 position; uint packedInfo; }; // bits 0-15 rotation, 16-23 meshType, 24-31 texture index
 layout(std430, binding = 0) buffer InstanceBuffer { GPUInstancePacked instances[]; };
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool uQuantized;
+uniform vec3 uQuantizeMin[16];    // per mesh type, from FoliageRenderer::buildCombinedBuffers
+uniform vec3 uQuantizeExtent[16];
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec3 TexCoord;
 
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // Lower hemisphere was folded over the diagonals
+    if(n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 void main() {
     // gl_BaseInstance provided per draw command in multi-draw indirect
     uint idx = gl_BaseInstance + gl_InstanceID;
-    mat4 M = instances[idx].model;
-    float tIndex = instances[idx].info.x;
-    vec4 worldPos = M * vec4(aPos, 1.0);
+    GPUInstancePacked inst = instances[idx];
+    // Y rotation as in glm::rotate; orthonormal, so it also transforms normals
+    float angle = float(inst.packedInfo & 0xFFFFu) * (6.28318530718 / 65536.0);
+    float s = sin(angle);
+    float c = cos(angle);
+    mat3 R = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    vec3 localPos = aPos;
+    vec3 localNormal = aNormal;
+    if(uQuantized) {
+        uint meshType = (inst.packedInfo >> 16) & 0xFFu;
+        localPos = uQuantizeMin[meshType] + aPos * uQuantizeExtent[meshType];
+        localNormal = octahedralDecode(aNormal.xy);
+    }
+    vec4 worldPos = vec4(R * localPos + inst.position, 1.0);
     FragPos = worldPos.xyz;
-    Normal = mat3(transpose(inverse(M))) * aNormal;
-    TexCoord = vec3(aTexCoord, tIndex);
+    Normal = R * localNormal;
+    TexCoord = vec3(aTexCoord, float(inst.packedInfo >> 24));
     gl_Position = projection * view * worldPos;
 }
\ No newline at end of file